@@ -0,0 +1,40 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+/*
+    Генератор псевдослучайных чисел на счётчике.
+
+    Значение - чистая функция от (зерно, поток, номер), поэтому не нужно
+    хранить и синхронизировать состояние: одно и то же решение получается
+    при повторном запуске и при любом разбиении работы между потоками.
+    Перемешивание - финализатор SplitMix64, применённый дважды.
+*/
+
+inline unsigned long long CounterMix(unsigned long long x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+//64 случайных бита для номера counter в потоке stream
+inline unsigned long long CounterRandom(unsigned long long seed, unsigned long long stream, unsigned long long counter)
+{
+    return CounterMix(CounterMix(seed ^ (stream * 0x9E3779B97F4A7C15ULL)) + counter * 0xD1B54A32D192ED03ULL);
+}
+
+//Порог для сравнения с 32 случайными битами, соответствующий вероятности probability
+inline unsigned long long CounterThreshold(double probability)
+{
+    if (probability <= 0)
+        return 0;
+    if (probability >= 1)
+        return 1ULL << 32;
+
+    return (unsigned long long)(probability * 4294967296.0);
+}
+
+#endif // COUNTER_RNG_H
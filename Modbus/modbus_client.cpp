@@ -0,0 +1,1010 @@
+#include "modbus_client.h"
+#include "modbus_general.h"
+#include <errno.h>
+#include <exception>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+
+ModbusLoop::ModbusLoop():
+    nextRegistration(1),
+    nextTimer(1),
+    stopped(false)
+{
+}
+
+
+long long ModbusLoop::Now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+void ModbusLoop::Watch(int fd, short events, std::function<void(short)> handler)
+{
+    std::unordered_map<int, Watcher>::iterator it = watchers.find(fd);
+    if (it != watchers.end())
+    {
+        polled[it->second.slot].events = events;
+        it->second.handler = handler;
+        return;
+    }
+
+    pollfd entry;
+    entry.fd = fd;
+    entry.events = events;
+    entry.revents = 0;
+
+    Watcher& watcher = watchers[fd];
+    watcher.slot = polled.size();
+    watcher.registration = nextRegistration++;
+    watcher.handler = handler;
+
+    polled.push_back(entry);
+}
+
+
+void ModbusLoop::SetEvents(int fd, short events)
+{
+    std::unordered_map<int, Watcher>::iterator it = watchers.find(fd);
+    if (it != watchers.end())
+        polled[it->second.slot].events = events;
+}
+
+
+void ModbusLoop::Unwatch(int fd)
+{
+    std::unordered_map<int, Watcher>::iterator it = watchers.find(fd);
+    if (it == watchers.end())
+        return;
+
+    //На место снятого дескриптора переносится последний
+    unsigned int slot = it->second.slot;
+    watchers.erase(it);
+
+    if (slot != polled.size() - 1)
+    {
+        polled[slot] = polled.back();
+        watchers[polled[slot].fd].slot = slot;
+    }
+    polled.pop_back();
+}
+
+
+unsigned long long ModbusLoop::AddTimer(long long deadline, std::function<void()> handler)
+{
+    unsigned long long id = nextTimer++;
+
+    Timer timer;
+    timer.deadline = deadline;
+    timer.id = id;
+    timers.push(timer);
+    timerHandlers[id] = handler;
+
+    return id;
+}
+
+
+void ModbusLoop::CancelTimer(unsigned long long id)
+{
+    //Отменённый таймер остаётся в очереди и пропускается при срабатывании
+    timerHandlers.erase(id);
+}
+
+
+void ModbusLoop::RunOnce(long long maxWaitUs)
+{
+    //Отменённые таймеры в начале очереди не должны влиять на время ожидания
+    while (!timers.empty() && timerHandlers.find(timers.top().id) == timerHandlers.end())
+        timers.pop();
+
+    long long wait = maxWaitUs;
+    if (!timers.empty())
+    {
+        long long until = timers.top().deadline - Now();
+        if (until < 0)
+            until = 0;
+        if (wait < 0 || until < wait)
+            wait = until;
+    }
+
+    //Нечего ждать
+    if (polled.empty() && wait < 0)
+    {
+        stopped = true;
+        return;
+    }
+
+    timespec timeout;
+    timeout.tv_sec = wait / 1000000;
+    timeout.tv_nsec = (wait % 1000000) * 1000;
+
+    int count = ppoll(polled.data(), polled.size(), wait < 0 ? NULL : &timeout, NULL);
+
+    /*Готовые дескрипторы выписываются до вызова обработчиков: обработчики
+    меняют polled (Watch/Unwatch переставляют элементы)*/
+    ready.clear();
+    for (unsigned int i = 0; count > 0 && i < polled.size(); ++i)
+    {
+        if (!polled[i].revents)
+            continue;
+        --count;
+
+        Ready entry;
+        entry.fd = polled[i].fd;
+        entry.revents = polled[i].revents;
+        entry.registration = watchers[polled[i].fd].registration;
+        ready.push_back(entry);
+
+        polled[i].revents = 0;
+    }
+
+    for (unsigned int i = 0; i < ready.size(); ++i)
+    {
+        /*Обработчик другого дескриптора мог снять этот дескриптор или снять
+        и поставить заново тот же номер: события прежней постановки новому
+        обработчику не передаются*/
+        std::unordered_map<int, Watcher>::iterator it = watchers.find(ready[i].fd);
+        if (it == watchers.end() || it->second.registration != ready[i].registration)
+            continue;
+
+        std::function<void(short)> handler = it->second.handler;
+        handler(ready[i].revents);
+    }
+
+    long long now = Now();
+    while (!timers.empty() && timers.top().deadline <= now)
+    {
+        unsigned long long id = timers.top().id;
+        timers.pop();
+
+        std::unordered_map<unsigned long long, std::function<void()>>::iterator it = timerHandlers.find(id);
+        if (it == timerHandlers.end())
+            continue;
+
+        std::function<void()> handler = it->second;
+        timerHandlers.erase(it);
+        handler();
+    }
+}
+
+
+void ModbusLoop::Run()
+{
+    stopped = false;
+    while (!stopped)
+        RunOnce();
+}
+
+
+
+
+void ModbusTask::promise_type::unhandled_exception()
+{
+    std::terminate();
+}
+
+
+ModbusOperation::ModbusOperation(ModbusClient* client, unsigned char* frame, unsigned int frameSize, unsigned int expectedSize):
+    client(client),
+    submitting(false),
+    finished(false)
+{
+    memcpy(request.frame, frame, frameSize);
+    request.frameSize = frameSize;
+    request.expectedSize = expectedSize;
+    request.responseSize = 0;
+    request.error = 0;
+    request.done = Resume;
+    request.context = this;
+    free(frame);
+}
+
+
+ModbusOperation::ModbusOperation(ModbusClient* client, unsigned char error):
+    client(client),
+    submitting(false),
+    finished(true)
+{
+    request.frameSize = 0;
+    request.expectedSize = 0;
+    request.responseSize = 0;
+    request.error = error;
+    request.done = Resume;
+    request.context = this;
+}
+
+
+void ModbusOperation::Resume(ModbusRequest* request, void* context)
+{
+    ModbusOperation* operation = (ModbusOperation*)context;
+    (void)request;
+
+    //Запрос завершился внутри Submit: сопрограмма ещё не приостановлена
+    if (operation->submitting)
+    {
+        operation->finished = true;
+        return;
+    }
+
+    operation->handle.resume();
+}
+
+
+bool ModbusOperation::await_suspend(std::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    submitting = true;
+    client->Submit(&request);
+    submitting = false;
+
+    return !finished;
+}
+
+
+ModbusResult ModbusOperation::await_resume()
+{
+    ModbusResult result;
+    result.error = request.error;
+    result.count = 0;
+
+    if (result.error || request.responseSize < 5 || (request.response[1] != 0x03 && request.response[1] != 0x04))
+        return result;
+
+    //Размер ответа проверен клиентом, но значения не должны выйти за values
+    result.count = request.response[2] / 2;
+    if (result.count > (request.responseSize - 5) / 2)
+        result.count = (request.responseSize - 5) / 2;
+    if (result.count > MODBUS_MAX_READ)
+        result.count = MODBUS_MAX_READ;
+    for (unsigned short i = 0; i < result.count; ++i)
+    {
+        if (client->Config().isHighLowOrder)
+            result.values[i] = request.response[3+2*i] << 8 | request.response[4+2*i];
+        else
+            result.values[i] = request.response[4+2*i] << 8 | request.response[3+2*i];
+    }
+
+    return result;
+}
+
+
+
+
+//Проверка CRC в конце кадра
+static bool IsValidCrc(unsigned char* buffer, unsigned int size)
+{
+    return size > 2 && CRC16(buffer, size-2) == (unsigned short)(buffer[size-1] << 8 | buffer[size-2]);
+}
+
+
+//Размер ответа соответствует запросу: исключение - 5 байт, иначе ожидаемый размер, если он известен
+static bool IsExpectedSize(const ModbusRequest* request, const unsigned char* response, unsigned int size)
+{
+    if (size > MODBUS_MAX_FRAME)
+        return false;
+
+    if (response[1] & 0x80U)
+        return size == 5;
+
+    return !request->expectedSize || size == request->expectedSize;
+}
+
+
+ModbusClient::ModbusClient(ModbusLoop& loop, const ModbusClientConfig& config):
+    loop(loop),
+    config(config),
+    transport(NONE),
+    fd(-1),
+    queueHead(NULL),
+    queueTail(NULL),
+    inputSize(0),
+    quietUntil(0),
+    silenceTimer(0),
+    gapTimer(0),
+    nextTransaction(0),
+    connecting(false),
+    completed(0),
+    retried(0),
+    failed(0)
+{
+}
+
+
+ModbusClient::~ModbusClient()
+{
+    Close();
+}
+
+
+bool ModbusClient::OpenRtu(const char* path)
+{
+    int port = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (port < 0)
+        return false;
+
+    //Скорость и формат символа настраиваются только для терминалов
+    termios tty;
+    if (tcgetattr(port, &tty) == 0)
+    {
+        speed_t speed;
+        switch (config.baud)
+        {
+        case 1200:   speed = B1200;   break;
+        case 2400:   speed = B2400;   break;
+        case 4800:   speed = B4800;   break;
+        case 19200:  speed = B19200;  break;
+        case 38400:  speed = B38400;  break;
+        case 57600:  speed = B57600;  break;
+        case 115200: speed = B115200; break;
+        default:     speed = B9600;   break;
+        }
+
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+        tty.c_cflag |= CLOCAL | CREAD;
+
+        tty.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+        if (config.parity == 'E' || config.parity == 'O')
+            tty.c_cflag |= PARENB;
+        if (config.parity == 'O')
+            tty.c_cflag |= PARODD;
+        if (config.stopBits >= 2)
+            tty.c_cflag |= CSTOPB;
+
+        tcsetattr(port, TCSANOW, &tty);
+    }
+
+    return AttachRtu(port);
+}
+
+
+bool ModbusClient::AttachRtu(int fd)
+{
+    Close();
+
+    if (fd < 0)
+        return false;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    this->fd = fd;
+    transport = RTU;
+    inputSize = 0;
+    quietUntil = 0;
+
+    loop.Watch(fd, POLLIN, [this](short revents) { OnReady(revents); });
+    Pump();
+
+    return true;
+}
+
+
+bool ModbusClient::OpenTcp(const char* host, unsigned short port)
+{
+    Close();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%hu", port);
+
+    addrinfo* addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return false;
+
+    int sock = socket(addresses->ai_family, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        freeaddrinfo(addresses);
+        return false;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int result = connect(sock, addresses->ai_addr, addresses->ai_addrlen);
+    freeaddrinfo(addresses);
+
+    if (result < 0 && errno != EINPROGRESS)
+    {
+        close(sock);
+        return false;
+    }
+
+    fd = sock;
+    transport = TCP;
+    inputSize = 0;
+    connecting = result < 0;
+
+    loop.Watch(fd, connecting ? POLLOUT : POLLIN, [this](short revents) { OnReady(revents); });
+    Pump();
+
+    return true;
+}
+
+
+void ModbusClient::Close()
+{
+    if (fd >= 0)
+    {
+        loop.Unwatch(fd);
+        close(fd);
+        fd = -1;
+    }
+
+    if (silenceTimer)
+        loop.CancelTimer(silenceTimer);
+    if (gapTimer)
+        loop.CancelTimer(gapTimer);
+    silenceTimer = gapTimer = 0;
+
+    transport = NONE;
+    connecting = false;
+    output.clear();
+    inputSize = 0;
+
+    FailAll(MODBUS_ERROR_IO);
+}
+
+
+unsigned int ModbusClient::ExpectedResponseSize(const unsigned char* frame, unsigned int size)
+{
+    //На широковещательные запросы ответа нет
+    if (size < 2 || frame[0] == 0)
+        return 0;
+
+    switch (frame[1])
+    {
+    case 0x03:
+    case 0x04:
+        return size >= 6 ? (frame[4] << 8 | frame[5]) * 2 + 5 : 0;
+    case 0x06:
+    case 0x10:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+
+void ModbusClient::Prepare(ModbusRequest* request, const unsigned char* frame, unsigned int size)
+{
+    if (size > MODBUS_MAX_FRAME - 2)
+        size = MODBUS_MAX_FRAME - 2;
+
+    memcpy(request->frame, frame, size);
+
+    unsigned short crc = CRC16(request->frame, size);
+    request->frame[size] = crc & 0xFFU;
+    request->frame[size + 1] = crc >> 8;
+
+    request->frameSize = size + 2;
+    request->expectedSize = ExpectedResponseSize(request->frame, request->frameSize);
+    request->responseSize = 0;
+    request->error = 0;
+}
+
+
+ModbusOperation ModbusClient::Read(unsigned char slaveAddress, unsigned short firstRegister, unsigned short countRegisters)
+{
+    if (!countRegisters || countRegisters > MODBUS_MAX_READ)
+        return ModbusOperation(this, MODBUS_ERROR_REQUEST);
+
+    unsigned int size;
+    unsigned char* frame = CreateBufferReadHoldingRegisters(slaveAddress, firstRegister, countRegisters, size);
+
+    return ModbusOperation(this, frame, size, ExpectedResponseSize(frame, size));
+}
+
+
+ModbusOperation ModbusClient::ReadInput(unsigned char slaveAddress, unsigned short firstRegister, unsigned short countRegisters)
+{
+    if (!countRegisters || countRegisters > MODBUS_MAX_READ)
+        return ModbusOperation(this, MODBUS_ERROR_REQUEST);
+
+    unsigned int size;
+    unsigned char* frame = CreateBufferReadInputRegisters(slaveAddress, firstRegister, countRegisters, size);
+
+    return ModbusOperation(this, frame, size, ExpectedResponseSize(frame, size));
+}
+
+
+ModbusOperation ModbusClient::WriteSingle(unsigned char slaveAddress, unsigned short paramAddress, unsigned short value)
+{
+    unsigned int size;
+    unsigned char* frame = CreateBufferWriteSingleHoldingRegister(slaveAddress, paramAddress, value, size,
+                                                                  config.isHighLowOrder);
+
+    return ModbusOperation(this, frame, size, ExpectedResponseSize(frame, size));
+}
+
+
+ModbusOperation ModbusClient::Write(unsigned char slaveAddress, unsigned short firstRegister,
+                                    unsigned short* values, unsigned short countRegisters)
+{
+    unsigned int size;
+    unsigned char* frame = CreateBufferWriteMultipleHoldingRegisters(slaveAddress, firstRegister, countRegisters,
+                                                                     countRegisters * 2, values, size,
+                                                                     config.isHighLowOrder);
+
+    return ModbusOperation(this, frame, size, ExpectedResponseSize(frame, size));
+}
+
+
+unsigned int ModbusClient::Pending() const
+{
+    unsigned int count = inFlight.size();
+    for (ModbusRequest* r = queueHead; r; r = r->next)
+        ++count;
+
+    return count;
+}
+
+
+void ModbusClient::Submit(ModbusRequest* request)
+{
+    request->attempts = 0;
+    request->timer = 0;
+    request->responseSize = 0;
+    request->error = 0;
+    request->next = NULL;
+
+    if (queueTail)
+        queueTail->next = request;
+    else
+        queueHead = request;
+    queueTail = request;
+
+    Pump();
+}
+
+
+long long ModbusClient::Timeout(const ModbusRequest* request) const
+{
+    if (config.timeoutUs)
+        return config.timeoutUs;
+
+    if (transport == TCP)
+        return 1000000;
+
+    //Передача запроса, передача самого длинного ожидаемого ответа,
+    //подготовка ответа slave-устройством и два межкадровых интервала
+    unsigned int responseSize = request->expectedSize ? request->expectedSize : MODBUS_MAX_FRAME;
+
+    return (request->frameSize + responseSize) * ModbusCharTime(config.baud, config.BitsPerChar())
+            + config.turnaroundUs + 2 * ModbusFrameGap(config.baud, config.BitsPerChar());
+}
+
+
+void ModbusClient::Pump()
+{
+    if (transport == NONE)
+    {
+        FailAll(MODBUS_ERROR_IO);
+        return;
+    }
+
+    if (transport == RTU)
+    {
+        //В линии RTU может находиться только один запрос
+        if (!queueHead || !inFlight.empty() || gapTimer)
+            return;
+
+        //Перед новым кадром линия должна молчать не меньше t3.5
+        long long now = ModbusLoop::Now();
+        if (now < quietUntil)
+        {
+            gapTimer = loop.AddTimer(quietUntil, [this]() { gapTimer = 0; Pump(); });
+            return;
+        }
+
+        ModbusRequest* request = queueHead;
+        queueHead = request->next;
+        if (!queueHead)
+            queueTail = NULL;
+
+        Send(request);
+        return;
+    }
+
+    if (connecting)
+        return;
+
+    //На TCP независимые запросы передаются конвейером
+    while (queueHead && inFlight.size() < config.maxInFlight)
+    {
+        ModbusRequest* request = queueHead;
+        queueHead = request->next;
+        if (!queueHead)
+            queueTail = NULL;
+
+        Send(request);
+    }
+}
+
+
+void ModbusClient::Send(ModbusRequest* request)
+{
+    request->attempts++;
+    request->sent = ModbusLoop::Now();
+    request->next = NULL;
+    inFlight.push_back(request);
+
+    if (transport == RTU)
+    {
+        inputSize = 0;
+        output.insert(output.end(), request->frame, request->frame + request->frameSize);
+
+        //Широковещательный запрос считается выполненным после передачи и времени на его обработку
+        if (request->frame[0] == 0)
+        {
+            long long done = request->sent + request->frameSize * ModbusCharTime(config.baud, config.BitsPerChar())
+                    + config.turnaroundUs;
+            request->timer = loop.AddTimer(done, [this, request]() { request->timer = 0; Complete(request, 0); });
+        }
+        else
+        {
+            request->timer = loop.AddTimer(request->sent + Timeout(request),
+                                           [this, request]() { OnTimeout(request); });
+        }
+    }
+    else
+    {
+        //Заголовок MBAP: номер транзакции, протокол, длина, адрес устройства
+        request->transaction = nextTransaction++;
+        unsigned short length = request->frameSize - 2;
+
+        unsigned char header[6];
+        header[0] = request->transaction >> 8;
+        header[1] = request->transaction & 0xFFU;
+        header[2] = 0;
+        header[3] = 0;
+        header[4] = length >> 8;
+        header[5] = length & 0xFFU;
+
+        output.insert(output.end(), header, header + 6);
+        output.insert(output.end(), request->frame, request->frame + length);
+
+        request->timer = loop.AddTimer(request->sent + Timeout(request), [this, request]() { OnTimeout(request); });
+    }
+
+    Flush();
+}
+
+
+void ModbusClient::Flush()
+{
+    while (!output.empty())
+    {
+        ssize_t written = write(fd, output.data(), output.size());
+        if (written < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+
+            Close();
+            return;
+        }
+
+        output.erase(output.begin(), output.begin() + written);
+    }
+
+    loop.SetEvents(fd, output.empty() ? POLLIN : (POLLIN | POLLOUT));
+}
+
+
+void ModbusClient::OnReady(short revents)
+{
+    if (connecting)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+        if (error || (revents & (POLLERR | POLLHUP)))
+        {
+            Close();
+            return;
+        }
+
+        connecting = false;
+        loop.SetEvents(fd, POLLIN);
+        Pump();
+        return;
+    }
+
+    if (revents & POLLOUT)
+        Flush();
+
+    if (fd >= 0 && (revents & POLLIN))
+    {
+        if (transport == RTU)
+            OnRtuInput();
+        else
+            OnTcpInput();
+    }
+    else if (fd >= 0 && (revents & (POLLERR | POLLHUP | POLLNVAL)))
+        Close();
+}
+
+
+void ModbusClient::OnRtuInput()
+{
+    for (;;)
+    {
+        ssize_t received = read(fd, input + inputSize, sizeof(input) - inputSize);
+        if (received == 0)
+        {
+            Close();
+            return;
+        }
+        if (received < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                Close();
+            break;
+        }
+
+        inputSize += received;
+        if (inputSize == sizeof(input))
+            break;
+    }
+
+    long long now = ModbusLoop::Now();
+    quietUntil = now + ModbusFrameGap(config.baud, config.BitsPerChar());
+
+    //Байты вне транзакции (опоздавший ответ, помехи) отбрасываются
+    if (inFlight.empty())
+    {
+        inputSize = 0;
+        return;
+    }
+
+    ModbusRequest* request = inFlight[0];
+
+    if (IsValidBufferSizeFromSlave(input, inputSize) && IsValidCrc(input, inputSize))
+    {
+        //Ответ должен прийти от того же устройства на ту же функцию и иметь ожидаемый размер
+        if (input[0] != request->frame[0] || (input[1] & 0x7FU) != request->frame[1]
+                || !IsExpectedSize(request, input, inputSize))
+        {
+            Retry(request, MODBUS_ERROR_FRAME);
+            return;
+        }
+
+        memcpy(request->response, input, inputSize);
+        request->responseSize = inputSize;
+        inputSize = 0;
+
+        Complete(request, (request->response[1] & 0x80U) ? request->response[2] : 0);
+        return;
+    }
+
+    if (inputSize >= MODBUS_MAX_FRAME)
+    {
+        Retry(request, MODBUS_ERROR_FRAME);
+        return;
+    }
+
+    //Кадр не закончен: если линия замолчит на t3.5, кадр считается испорченным
+    if (silenceTimer)
+        loop.CancelTimer(silenceTimer);
+    silenceTimer = loop.AddTimer(quietUntil, [this]() { silenceTimer = 0; OnSilence(); });
+}
+
+
+void ModbusClient::OnSilence()
+{
+    if (inFlight.empty() || !inputSize)
+        return;
+
+    //Поток мог задержаться: байты, уже лежащие в дескрипторе, пришли до конца t3.5 и продолжают кадр
+    int available = 0;
+    if (ioctl(fd, FIONREAD, &available) == 0 && available > 0)
+    {
+        OnRtuInput();
+        return;
+    }
+
+    Retry(inFlight[0], MODBUS_ERROR_FRAME);
+}
+
+
+void ModbusClient::OnTcpInput()
+{
+    ssize_t received = read(fd, input + inputSize, sizeof(input) - inputSize);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        Close();
+        return;
+    }
+    if (received < 0)
+        return;
+
+    inputSize += received;
+
+    //Разбор всех полностью принятых кадров
+    while (inputSize >= 7)
+    {
+        unsigned short length = input[4] << 8 | input[5];
+        if (length < 2 || length > MODBUS_MAX_FRAME - 2)
+        {
+            Close();
+            return;
+        }
+
+        unsigned int total = 6 + length;
+        if (inputSize < total)
+            break;
+
+        unsigned short transaction = input[0] << 8 | input[1];
+
+        ModbusRequest* request = NULL;
+        for (unsigned int i = 0; i < inFlight.size(); ++i)
+        {
+            if (inFlight[i]->transaction == transaction)
+            {
+                request = inFlight[i];
+                break;
+            }
+        }
+
+        //Ответы на повторённые или снятые по таймауту запросы пропускаются
+        if (request)
+        {
+            //Ответ приводится к виду кадра RTU, чтобы проверить его теми же функциями
+            memcpy(request->response, input + 6, length);
+            unsigned short crc = CRC16(request->response, length);
+            request->response[length] = crc & 0xFFU;
+            request->response[length + 1] = crc >> 8;
+            request->responseSize = length + 2;
+
+            //Ответ должен прийти от того же устройства (unit id) на ту же функцию
+            if (!IsValidBufferSizeFromSlave(request->response, request->responseSize)
+                    || request->response[0] != request->frame[0]
+                    || (request->response[1] & 0x7FU) != request->frame[1]
+                    || !IsExpectedSize(request, request->response, request->responseSize))
+                Retry(request, MODBUS_ERROR_FRAME);
+            else
+                Complete(request, (request->response[1] & 0x80U) ? request->response[2] : 0);
+
+            if (fd < 0)
+                return;
+        }
+
+        memmove(input, input + total, inputSize - total);
+        inputSize -= total;
+    }
+}
+
+
+void ModbusClient::OnTimeout(ModbusRequest* request)
+{
+    request->timer = 0;
+    Retry(request, MODBUS_ERROR_TIMEOUT);
+}
+
+
+void ModbusClient::Retry(ModbusRequest* request, unsigned char error)
+{
+    for (unsigned int i = 0; i < inFlight.size(); ++i)
+    {
+        if (inFlight[i] == request)
+        {
+            inFlight.erase(inFlight.begin() + i);
+            break;
+        }
+    }
+
+    if (request->timer)
+    {
+        loop.CancelTimer(request->timer);
+        request->timer = 0;
+    }
+
+    if (transport == RTU)
+    {
+        inputSize = 0;
+        long long quiet = ModbusLoop::Now() + ModbusFrameGap(config.baud, config.BitsPerChar());
+        if (quiet > quietUntil)
+            quietUntil = quiet;
+    }
+
+    if (request->attempts > config.retries)
+    {
+        Complete(request, error);
+        return;
+    }
+
+    //Повтор ставится в начало очереди, чтобы не нарушать порядок запросов шины
+    ++retried;
+    request->next = queueHead;
+    queueHead = request;
+    if (!queueTail)
+        queueTail = request;
+
+    Pump();
+}
+
+
+void ModbusClient::Complete(ModbusRequest* request, unsigned char error)
+{
+    for (unsigned int i = 0; i < inFlight.size(); ++i)
+    {
+        if (inFlight[i] == request)
+        {
+            inFlight.erase(inFlight.begin() + i);
+            break;
+        }
+    }
+
+    if (request->timer)
+    {
+        loop.CancelTimer(request->timer);
+        request->timer = 0;
+    }
+
+    if (transport == RTU)
+    {
+        long long quiet = ModbusLoop::Now() + ModbusFrameGap(config.baud, config.BitsPerChar());
+        if (quiet > quietUntil)
+            quietUntil = quiet;
+    }
+
+    request->error = error;
+    if (error)
+        ++failed;
+    else
+        ++completed;
+
+    //Функция завершения может сразу поставить следующий запрос
+    request->done(request, request->context);
+
+    if (transport != NONE)
+        Pump();
+}
+
+
+void ModbusClient::FailAll(unsigned char error)
+{
+    std::vector<ModbusRequest*> requests;
+    requests.swap(inFlight);
+
+    for (ModbusRequest* r = queueHead; r; r = r->next)
+        requests.push_back(r);
+    queueHead = queueTail = NULL;
+
+    for (unsigned int i = 0; i < requests.size(); ++i)
+    {
+        if (requests[i]->timer)
+        {
+            loop.CancelTimer(requests[i]->timer);
+            requests[i]->timer = 0;
+        }
+
+        requests[i]->error = error;
+        ++failed;
+        requests[i]->done(requests[i], requests[i]->context);
+    }
+}
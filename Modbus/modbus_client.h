@@ -0,0 +1,309 @@
+#ifndef MODBUS_CLIENT_H
+#define MODBUS_CLIENT_H
+
+#include <coroutine>
+#include <functional>
+#include <poll.h>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Асинхронный master-клиент Modbus поверх RTU (последовательный порт, pty)
+    и TCP.
+
+    Все шины обслуживаются одним потоком: ModbusLoop ожидает готовности
+    дескрипторов через ppoll() по постоянному массиву и ведёт очередь
+    таймеров. Каждый ModbusClient - это одна шина со своей очередью
+    запросов. На RTU в линии находится не более одного запроса, между
+    кадрами выдерживается интервал t3.5, а время ожидания ответа
+    вычисляется из скорости линии. На TCP независимые запросы передаются
+    конвейером, ответы сопоставляются по номеру транзакции.
+
+    Использование из сопрограммы:
+
+    ModbusTask Poll(ModbusClient& client)
+    {
+        ModbusResult result = co_await client.Read(1, RG_TV, 2);
+        if (!result.error) ...
+    }
+
+    Кадры формируются функциями CreateBuffer*, ответы проверяются
+    IsValidBufferSizeFromSlave и CRC16.
+*/
+
+#define MODBUS_MAX_FRAME        (256)   //Максимальный размер кадра RTU
+
+//Коды ошибок, формируемые клиентом (коды исключений slave-устройства лежат в диапазоне 0x01-0x0B)
+#define MODBUS_ERROR_TIMEOUT    (0xE0)  //Нет ответа после всех повторов
+#define MODBUS_ERROR_FRAME      (0xE1)  //Ответ некорректной длины, с неверным CRC или от другого устройства
+#define MODBUS_ERROR_IO         (0xE2)  //Ошибка ввода-вывода или разрыв соединения
+#define MODBUS_ERROR_REQUEST    (0xE3)  //Запрос не отправлен: недопустимое количество регистров
+
+#define MODBUS_MAX_READ         (125)   //Наибольшее количество регистров в одном чтении
+
+
+//Время передачи одного символа в микросекундах (по умолчанию 8E1 - 11 бит на символ)
+inline long long ModbusCharTime(unsigned int baud, unsigned char bitsPerChar = 11)
+{
+    return (bitsPerChar * 1000000LL + baud - 1) / baud;
+}
+
+//Межкадровый интервал t3.5 в микросекундах (для скоростей выше 19200 - фиксированные 1750 мкс)
+inline long long ModbusFrameGap(unsigned int baud, unsigned char bitsPerChar = 11)
+{
+    if (baud > 19200)
+        return 1750;
+
+    return (35LL * bitsPerChar * 1000000LL + 10LL * baud - 1) / (10LL * baud);
+}
+
+
+
+
+//Цикл обработки событий: дескрипторы и таймеры
+class ModbusLoop
+{
+    struct Timer
+    {
+        long long deadline;
+        unsigned long long id;
+        bool operator>(const Timer& other) const
+        {
+            return deadline > other.deadline || (deadline == other.deadline && id > other.id);
+        }
+    };
+
+    //Наблюдение за дескриптором
+    struct Watcher
+    {
+        unsigned int slot;                      //индекс в polled
+        unsigned long long registration;        //номер постановки на наблюдение
+        std::function<void(short)> handler;     //обработчик готовности
+    };
+
+    //Готовый дескриптор текущей итерации
+    struct Ready
+    {
+        int fd;
+        short revents;
+        unsigned long long registration;
+    };
+
+    /*Массив для ppoll хранится между итерациями и меняется только в Watch,
+    SetEvents и Unwatch, так что итерация не собирает его заново, а смена
+    событий дескриптора не ищет его перебором*/
+    std::vector<pollfd> polled;                     //наблюдаемые дескрипторы и ожидаемые события
+    std::unordered_map<int, Watcher> watchers;
+    std::vector<Ready> ready;
+    unsigned long long nextRegistration;
+
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::unordered_map<unsigned long long, std::function<void()>> timerHandlers;
+    unsigned long long nextTimer;
+
+    bool stopped;
+public:
+    ModbusLoop();
+
+    //Текущее монотонное время в микросекундах
+    static long long Now();
+
+    //Наблюдать за дескриптором fd (events - POLLIN/POLLOUT)
+    void Watch(int fd, short events, std::function<void(short)> handler);
+    void SetEvents(int fd, short events);
+    void Unwatch(int fd);
+
+    //Вызвать handler в момент deadline (в микросекундах по Now), возвращает идентификатор таймера
+    unsigned long long AddTimer(long long deadline, std::function<void()> handler);
+    void CancelTimer(unsigned long long id);
+
+    //Одна итерация: ожидание не дольше maxWaitUs (-1 - до ближайшего таймера), обработка событий
+    void RunOnce(long long maxWaitUs = -1);
+
+    //Обработка событий до вызова Stop
+    void Run();
+    void Stop() { stopped = true; }
+};
+
+
+
+
+//Запрос к slave-устройству (интерфейс без сопрограмм)
+struct ModbusRequest
+{
+    unsigned char frame[MODBUS_MAX_FRAME];      //кадр RTU вместе с CRC
+    unsigned int frameSize;
+    unsigned int expectedSize;                  //ожидаемый размер ответа (0 - неизвестен)
+
+    unsigned char response[MODBUS_MAX_FRAME];   //кадр-ответ в формате RTU вместе с CRC
+    unsigned int responseSize;
+    unsigned char error;                        //0, код исключения slave-устройства или MODBUS_ERROR_*
+
+    //Функция, вызываемая по завершении запроса
+    void (*done)(ModbusRequest* request, void* context);
+    void* context;
+
+    //Служебные поля клиента
+    unsigned int attempts;
+    unsigned short transaction;
+    unsigned long long timer;
+    long long sent;
+    ModbusRequest* next;
+};
+
+//Результат чтения или записи регистров
+struct ModbusResult
+{
+    unsigned char error;            //0, код исключения slave-устройства или MODBUS_ERROR_*
+    unsigned short count;           //количество прочитанных значений
+    unsigned short values[MODBUS_MAX_READ]; //прочитанные значения
+};
+
+
+//Сопрограмма, запускаемая сразу и уничтожающая себя по завершении
+struct ModbusTask
+{
+    struct promise_type
+    {
+        ModbusTask get_return_object() { return ModbusTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+};
+
+
+//Параметры шины
+struct ModbusClientConfig
+{
+    unsigned int baud = 9600;           //скорость линии RTU
+    char parity = 'E';                  //чётность линии RTU: 'N', 'E' или 'O'
+    unsigned char stopBits = 1;         //стоповых бит линии RTU
+    long long turnaroundUs = 100000;    //допустимое время подготовки ответа slave-устройством
+    long long timeoutUs = 0;            //время ожидания ответа (0 - по скорости линии для RTU, 1 с для TCP)
+    unsigned int retries = 2;           //число повторов после ошибки
+    unsigned int maxInFlight = 16;      //число одновременных транзакций на TCP
+    char isHighLowOrder = 0;            //порядок следования байтов в значениях регистров (по умолчанию LowHigh)
+
+    //Бит на символ вместе со стартовым (8 бит данных)
+    unsigned char BitsPerChar() const { return 1 + 8 + (parity != 'N') + stopBits; }
+};
+
+
+class ModbusClient;
+
+//Ожидаемая операция: co_await client.Read(...)
+class ModbusOperation
+{
+    ModbusClient* client;
+    ModbusRequest request;
+    std::coroutine_handle<> handle;
+    bool submitting;                //запрос ещё ставится в очередь
+    bool finished;                  //запрос завершился, не дойдя до приостановки
+
+    static void Resume(ModbusRequest* request, void* context);
+public:
+    ModbusOperation(ModbusClient* client, unsigned char* frame, unsigned int frameSize, unsigned int expectedSize);
+
+    //Операция, завершённая без отправки с ошибкой error
+    ModbusOperation(ModbusClient* client, unsigned char error);
+
+    bool await_ready() const noexcept { return finished; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    ModbusResult await_resume();
+};
+
+
+class ModbusClient
+{
+    enum Transport
+    {
+        NONE = 0,
+        RTU,
+        TCP
+    };
+
+    ModbusLoop& loop;
+    ModbusClientConfig config;
+    Transport transport;
+    int fd;
+
+    //Очередь ожидающих отправки запросов
+    ModbusRequest* queueHead;
+    ModbusRequest* queueTail;
+
+    //Отправленные запросы, ожидающие ответа
+    std::vector<ModbusRequest*> inFlight;
+
+    //Передаваемые и принимаемые байты
+    std::vector<unsigned char> output;
+    unsigned char input[MODBUS_MAX_FRAME + 7];
+    unsigned int inputSize;
+
+    //Состояние RTU
+    long long quietUntil;               //момент, до которого линия должна молчать (t3.5)
+    unsigned long long silenceTimer;    //таймер окончания приёма кадра
+    unsigned long long gapTimer;        //таймер следующей отправки
+
+    //Состояние TCP
+    unsigned short nextTransaction;
+    bool connecting;
+
+    //Статистика
+    unsigned long long completed;
+    unsigned long long retried;
+    unsigned long long failed;
+
+    long long Timeout(const ModbusRequest* request) const;
+    void Pump();
+    void Send(ModbusRequest* request);
+    void Flush();
+    void OnReady(short revents);
+    void OnRtuInput();
+    void OnTcpInput();
+    void OnTimeout(ModbusRequest* request);
+    void OnSilence();
+    void Retry(ModbusRequest* request, unsigned char error);
+    void Complete(ModbusRequest* request, unsigned char error);
+    void FailAll(unsigned char error);
+public:
+    ModbusClient(ModbusLoop& loop, const ModbusClientConfig& config = ModbusClientConfig());
+    ~ModbusClient();
+
+    //Открыть последовательный порт или pty и настроить скорость
+    bool OpenRtu(const char* path);
+
+    //Использовать уже открытый дескриптор как линию RTU
+    bool AttachRtu(int fd);
+
+    //Подключиться к Modbus TCP серверу
+    bool OpenTcp(const char* host, unsigned short port);
+
+    void Close();
+
+    //Поставить запрос в очередь шины
+    void Submit(ModbusRequest* request);
+
+    //Подготовить запрос из кадра RTU без CRC (адрес, функция, данные)
+    static void Prepare(ModbusRequest* request, const unsigned char* frame, unsigned int size);
+
+    //Ожидаемый размер ответа на кадр (0 - ответа не будет или размер заранее неизвестен)
+    static unsigned int ExpectedResponseSize(const unsigned char* frame, unsigned int size);
+
+    //Операции для сопрограмм
+    ModbusOperation Read(unsigned char slaveAddress, unsigned short firstRegister, unsigned short countRegisters);
+    ModbusOperation ReadInput(unsigned char slaveAddress, unsigned short firstRegister, unsigned short countRegisters);
+    ModbusOperation WriteSingle(unsigned char slaveAddress, unsigned short paramAddress, unsigned short value);
+    ModbusOperation Write(unsigned char slaveAddress, unsigned short firstRegister,
+                          unsigned short* values, unsigned short countRegisters);
+
+    const ModbusClientConfig& Config() const { return config; }
+    unsigned int Pending() const;
+    unsigned long long Completed() const { return completed; }
+    unsigned long long Retried() const { return retried; }
+    unsigned long long Failed() const { return failed; }
+};
+
+#endif // MODBUS_CLIENT_H
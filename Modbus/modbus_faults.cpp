@@ -0,0 +1,106 @@
+#include "modbus_faults.h"
+#include "counter_rng.h"
+
+
+ModbusFaults::ModbusFaults(unsigned long long seed, const ModbusFaultConfig& config):
+    seed(seed)
+{
+    common = Compile(config);
+
+    for (unsigned int i = 0; i < 256; ++i)
+        hasDevice[i] = false;
+
+    ResetCounts();
+}
+
+
+ModbusFaults::Thresholds ModbusFaults::Compile(const ModbusFaultConfig& config)
+{
+    double probability[FAULT_COUNT] = { 0 };
+    probability[FAULT_BIT_ERROR] = config.bitError;
+    probability[FAULT_DROP] = config.drop;
+    probability[FAULT_LATE] = config.late;
+    probability[FAULT_FAILURE] = config.failure;
+    probability[FAULT_BUSY] = config.busy;
+    probability[FAULT_TRUNCATE] = config.truncate;
+
+    //Границы интервалов, на которые делится диапазон 32 случайных бит
+    Thresholds result;
+    double sum = 0;
+    result.bound[FAULT_NONE] = 0;
+    for (int f = FAULT_NONE + 1; f < FAULT_COUNT; ++f)
+    {
+        sum += probability[f];
+        result.bound[f] = CounterThreshold(sum);
+    }
+
+    result.lateUs = config.lateUs;
+    result.active = result.bound[FAULT_COUNT - 1] != 0;
+
+    return result;
+}
+
+
+void ModbusFaults::Configure(const ModbusFaultConfig& config)
+{
+    common = Compile(config);
+}
+
+
+void ModbusFaults::ConfigureDevice(unsigned char address, const ModbusFaultConfig& config)
+{
+    devices[address] = Compile(config);
+    hasDevice[address] = true;
+}
+
+
+ModbusFaultDecision ModbusFaults::Decide(unsigned int bus, unsigned char address, unsigned long long frame) const
+{
+    ModbusFaultDecision decision;
+    decision.fault = FAULT_NONE;
+    decision.parameter = 0;
+
+    const Thresholds& t = hasDevice[address] ? devices[address] : common;
+    if (!t.active)
+        return decision;
+
+    //Младшие 32 бита выбирают неисправность, старшие - её параметр
+    unsigned long long random = CounterRandom(seed, (unsigned long long)bus << 8 | address, frame);
+    unsigned long long value = random & 0xFFFFFFFFULL;
+
+    for (int f = FAULT_NONE + 1; f < FAULT_COUNT; ++f)
+    {
+        if (value < t.bound[f])
+        {
+            decision.fault = (ModbusFault)f;
+            break;
+        }
+    }
+
+    decision.parameter = (unsigned int)(random >> 32);
+
+    return decision;
+}
+
+
+long long ModbusFaults::LateUs(unsigned char address) const
+{
+    return hasDevice[address] ? devices[address].lateUs : common.lateUs;
+}
+
+
+unsigned long long ModbusFaults::Frames() const
+{
+    unsigned long long total = 0;
+    for (int f = 0; f < FAULT_COUNT; ++f)
+        total += Injected((ModbusFault)f);
+
+    return total;
+}
+
+
+void ModbusFaults::ResetCounts()
+{
+    for (int f = 0; f < FAULT_COUNT; ++f)
+        counts[f].store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,98 @@
+#ifndef MODBUS_FAULTS_H
+#define MODBUS_FAULTS_H
+
+#include <atomic>
+
+/*
+    Внесение неисправностей в обмен по шине для испытаний master-устройств
+    под нагрузкой и подбора числа повторов.
+
+    Для каждого кадра принимается одно решение: кадр проходит без искажений
+    или с одной из неисправностей. Решение - функция от зерна, номера шины,
+    адреса устройства и номера кадра на шине (см. counter_rng.h), поэтому
+    прогоны воспроизводимы и не требуют синхронизации между потоками.
+    Число внесённых неисправностей каждого вида доступно для сравнения
+    потерь пропускной способности с заданной частотой неисправностей.
+*/
+
+//Виды неисправностей
+enum ModbusFault
+{
+    FAULT_NONE = 0,
+    FAULT_BIT_ERROR,    //искажение бита в запросе: CRC не сходится, slave-устройство молчит
+    FAULT_DROP,         //запрос выполнен, ответ потерян
+    FAULT_LATE,         //ответ опаздывает на lateUs
+    FAULT_FAILURE,      //ответ исключением 0x04 (неисправность оборудования)
+    FAULT_BUSY,         //ответ исключением 0x06 (устройство занято)
+    FAULT_TRUNCATE,     //ответ обрезан
+    FAULT_COUNT
+};
+
+
+//Вероятности неисправностей на один кадр (в сумме не больше 1)
+struct ModbusFaultConfig
+{
+    double bitError = 0;
+    double drop = 0;
+    double late = 0;
+    double failure = 0;
+    double busy = 0;
+    double truncate = 0;
+    long long lateUs = 0;               //величина опоздания ответа для FAULT_LATE
+};
+
+
+//Решение для одного кадра
+struct ModbusFaultDecision
+{
+    ModbusFault fault;
+    unsigned int parameter;     //случайный параметр: номер искажаемого бита, длина обрезанного ответа
+};
+
+
+class ModbusFaults
+{
+    //Пороги неисправностей, накопленные в порядке перечисления ModbusFault
+    struct Thresholds
+    {
+        unsigned long long bound[FAULT_COUNT];
+        long long lateUs;
+        bool active;
+    };
+
+    unsigned long long seed;
+    Thresholds common;                  //для всех устройств
+    Thresholds devices[256];            //для отдельных адресов
+    bool hasDevice[256];
+
+    std::atomic<unsigned long long> counts[FAULT_COUNT];
+
+    static Thresholds Compile(const ModbusFaultConfig& config);
+public:
+    explicit ModbusFaults(unsigned long long seed = 0, const ModbusFaultConfig& config = ModbusFaultConfig());
+
+    //Параметры для всех устройств
+    void Configure(const ModbusFaultConfig& config);
+
+    //Параметры для устройства с адресом address (заменяют общие)
+    void ConfigureDevice(unsigned char address, const ModbusFaultConfig& config);
+
+    //Решение для кадра номер frame на шине bus, адресованного устройству address
+    ModbusFaultDecision Decide(unsigned int bus, unsigned char address, unsigned long long frame) const;
+
+    //Опоздание ответа для устройства address
+    long long LateUs(unsigned char address) const;
+
+    //Учёт внесённой неисправности
+    void Count(ModbusFault fault) { counts[fault].fetch_add(1, std::memory_order_relaxed); }
+
+    //Число кадров с неисправностью fault (FAULT_NONE - кадры без неисправностей)
+    unsigned long long Injected(ModbusFault fault) const { return counts[fault].load(std::memory_order_relaxed); }
+
+    //Общее число кадров
+    unsigned long long Frames() const;
+
+    void ResetCounts();
+};
+
+#endif // MODBUS_FAULTS_H
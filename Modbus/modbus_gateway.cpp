@@ -0,0 +1,533 @@
+#include "modbus_gateway.h"
+#include "modbus_general.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+ModbusGateway::ModbusGateway(ModbusLoop& loop, const ModbusGatewayConfig& config):
+    loop(loop),
+    config(config),
+    listener(-1),
+    nextConnection(1),
+    requests(0),
+    forwarded(0),
+    merged(0),
+    cached(0),
+    rejected(0)
+{
+    for (unsigned int i = 0; i < 256; ++i)
+    {
+        routes[i] = -1;
+        generations[i] = 0;
+    }
+}
+
+
+ModbusGateway::~ModbusGateway()
+{
+    Close();
+
+    for (unsigned int b = 0; b < buses.size(); ++b)
+    {
+        Bus& bus = buses[b];
+        for (std::unordered_map<unsigned long long, std::deque<Pending*>>::iterator it = bus.queues.begin();
+             it != bus.queues.end(); ++it)
+        {
+            for (unsigned int i = 0; i < it->second.size(); ++i)
+                delete it->second[i];
+        }
+
+        //Запрос на линии принадлежит шине до завершения и удаляется в Done
+        if (bus.current)
+            bus.current->gateway = NULL;
+    }
+}
+
+
+bool ModbusGateway::Listen(unsigned short port, const char* host)
+{
+    Close();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%hu", port);
+
+    addrinfo* addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return false;
+
+    int sock = socket(addresses->ai_family, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        freeaddrinfo(addresses);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int result = bind(sock, addresses->ai_addr, addresses->ai_addrlen);
+    freeaddrinfo(addresses);
+
+    if (result < 0 || listen(sock, 128) < 0)
+    {
+        close(sock);
+        return false;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    listener = sock;
+    loop.Watch(listener, POLLIN, [this](short) { OnAccept(); });
+
+    return true;
+}
+
+
+void ModbusGateway::Close()
+{
+    if (listener >= 0)
+    {
+        loop.Unwatch(listener);
+        close(listener);
+        listener = -1;
+    }
+
+    while (!connections.empty())
+        Drop(connections.begin()->first);
+}
+
+
+unsigned int ModbusGateway::AddBus(ModbusClient* client)
+{
+    Bus bus;
+    bus.client = client;
+    bus.current = NULL;
+    buses.push_back(bus);
+
+    return buses.size() - 1;
+}
+
+
+void ModbusGateway::Route(unsigned char first, unsigned char last, unsigned int bus)
+{
+    for (unsigned int address = first; address <= last; ++address)
+        routes[address] = bus;
+}
+
+
+void ModbusGateway::OnAccept()
+{
+    for (;;)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            return;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        unsigned long long id = nextConnection++;
+        Connection& connection = connections[id];
+        connection.fd = fd;
+        connection.parsing = false;
+
+        loop.Watch(fd, POLLIN, [this, id](short revents) { OnReady(id, revents); });
+    }
+}
+
+
+void ModbusGateway::Drop(unsigned long long id)
+{
+    std::unordered_map<unsigned long long, Connection>::iterator it = connections.find(id);
+    if (it == connections.end())
+        return;
+
+    //Запросы клиента в очередях шин остаются и пропускаются при выборе (Dispatch)
+    loop.Unwatch(it->second.fd);
+    close(it->second.fd);
+    connections.erase(it);
+}
+
+
+void ModbusGateway::OnReady(unsigned long long id, short revents)
+{
+    std::unordered_map<unsigned long long, Connection>::iterator it = connections.find(id);
+    if (it == connections.end())
+        return;
+
+    if (revents & POLLOUT)
+    {
+        Flush(id);
+        if (connections.find(id) == connections.end())
+            return;
+    }
+
+    if (!(revents & (POLLIN | POLLERR | POLLHUP)))
+        return;
+
+    Connection& connection = it->second;
+
+    unsigned char buffer[4096];
+    ssize_t received = read(connection.fd, buffer, sizeof(buffer));
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        Drop(id);
+        return;
+    }
+    if (received < 0)
+        return;
+
+    connection.input.insert(connection.input.end(), buffer, buffer + received);
+
+    //Разбор всех полностью принятых кадров; ответы из кэша копятся и отправляются одной записью
+    connection.parsing = true;
+
+    unsigned int position = 0;
+    while (connection.input.size() - position >= 7)
+    {
+        const unsigned char* mbap = &connection.input[position];
+        unsigned short protocol = mbap[2] << 8 | mbap[3];
+        unsigned short length = mbap[4] << 8 | mbap[5];
+
+        //Длина: адрес устройства и PDU, кадр RTU с CRC должен уместиться в MODBUS_MAX_FRAME
+        if (protocol != 0 || length < 2 || length > MODBUS_MAX_FRAME - 2)
+        {
+            Drop(id);
+            return;
+        }
+
+        unsigned int total = 6 + length;
+        if (connection.input.size() - position < total)
+            break;
+
+        OnRequest(id, mbap, total);
+        position += total;
+    }
+
+    connection.input.erase(connection.input.begin(), connection.input.begin() + position);
+    connection.parsing = false;
+
+    Flush(id);
+}
+
+
+void ModbusGateway::OnRequest(unsigned long long id, const unsigned char* mbap, unsigned int size)
+{
+    ++requests;
+
+    Waiter waiter;
+    waiter.connection = id;
+    waiter.transaction = mbap[0] << 8 | mbap[1];
+    waiter.unit = mbap[6];
+
+    //Запрос приводится к виду кадра RTU, чтобы проверить его теми же функциями, что и на slave-устройстве
+    unsigned char frame[MODBUS_MAX_FRAME];
+    unsigned int frameSize = size - 6;
+    memcpy(frame, mbap + 6, frameSize);
+
+    unsigned short crc = CRC16(frame, frameSize);
+    frame[frameSize] = crc & 0xFFU;
+    frame[frameSize + 1] = crc >> 8;
+
+    unsigned char address = frame[0];
+    unsigned char function = frame[1];
+
+    if (!IsValidBufferSizeFromMaster(frame, frameSize + 2))
+    {
+        ++rejected;
+
+        bool isKnown = function == 0x03 || function == 0x04 || function == 0x06 || function == 0x10;
+        ReplyError(waiter, address, function, isKnown ? MODBUS_EXCEPTION_ILLEGAL_VALUE : MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
+        return;
+    }
+
+    if (routes[address] < 0)
+    {
+        ++rejected;
+        ReplyError(waiter, address, function, MODBUS_EXCEPTION_PATH_UNAVAILABLE);
+        return;
+    }
+
+    bool isRead = function == 0x03 || function == 0x04;
+    std::string key;
+
+    if (isRead)
+    {
+        key.assign((const char*)frame, frameSize);
+
+        if (config.cacheTtlUs > 0)
+        {
+            std::unordered_map<std::string, CacheEntry>::iterator it = cache.find(key);
+            if (it != cache.end())
+            {
+                if (it->second.expires > ModbusLoop::Now() && it->second.generation == generations[address])
+                {
+                    ++cached;
+                    Reply(waiter, it->second.response.data(), it->second.response.size());
+                    return;
+                }
+
+                cache.erase(it);
+            }
+        }
+
+        std::unordered_map<std::string, Pending*>::iterator it = reads.find(key);
+        if (it != reads.end())
+        {
+            ++merged;
+            it->second->waiters.push_back(waiter);
+            return;
+        }
+    }
+
+    Bus& bus = buses[routes[address]];
+
+    std::deque<Pending*>& queue = bus.queues[id];
+    if (queue.size() >= config.maxQueued)
+    {
+        if (queue.empty())
+            bus.queues.erase(id);
+
+        ++rejected;
+        ReplyError(waiter, address, function, MODBUS_EXCEPTION_BUSY);
+        return;
+    }
+
+    //Запись меняет память устройства: ранее поставленные чтения и кэш для новых запросов не годятся
+    if (!isRead)
+        Forget(address);
+
+    Pending* pending = new Pending();
+    ModbusClient::Prepare(&pending->request, frame, frameSize);
+    pending->request.done = Done;
+    pending->request.context = pending;
+    pending->gateway = this;
+    pending->bus = routes[address];
+    pending->key = key;
+    pending->generation = generations[address];
+    pending->waiters.push_back(waiter);
+
+    if (isRead)
+        reads[key] = pending;
+
+    if (queue.empty())
+        bus.order.push_back(id);
+    queue.push_back(pending);
+
+    Dispatch(pending->bus);
+}
+
+
+void ModbusGateway::Forget(unsigned char address)
+{
+    ++generations[address];
+
+    for (std::unordered_map<std::string, Pending*>::iterator it = reads.begin(); it != reads.end(); )
+    {
+        if ((unsigned char)it->first[0] == address)
+            it = reads.erase(it);
+        else
+            ++it;
+    }
+}
+
+
+void ModbusGateway::Release(Pending* pending)
+{
+    if (!pending->key.empty())
+    {
+        std::unordered_map<std::string, Pending*>::iterator it = reads.find(pending->key);
+        if (it != reads.end() && it->second == pending)
+            reads.erase(it);
+    }
+
+    delete pending;
+}
+
+
+void ModbusGateway::Dispatch(unsigned int index)
+{
+    Bus& bus = buses[index];
+
+    //Клиенты обслуживаются по кругу, по одному запросу за раз
+    while (!bus.current && !bus.order.empty())
+    {
+        unsigned long long id = bus.order.front();
+        bus.order.pop_front();
+
+        std::deque<Pending*>& queue = bus.queues[id];
+        Pending* pending = queue.front();
+        queue.pop_front();
+
+        if (queue.empty())
+            bus.queues.erase(id);
+        else
+            bus.order.push_back(id);
+
+        //Ответы отключившимся клиентам не нужны
+        std::vector<Waiter>& waiters = pending->waiters;
+        for (unsigned int i = 0; i < waiters.size(); )
+        {
+            if (connections.find(waiters[i].connection) == connections.end())
+            {
+                waiters[i] = waiters.back();
+                waiters.pop_back();
+            }
+            else
+                ++i;
+        }
+
+        if (waiters.empty())
+        {
+            Release(pending);
+            continue;
+        }
+
+        ++forwarded;
+        bus.current = pending;
+        bus.client->Submit(&pending->request);
+    }
+}
+
+
+void ModbusGateway::Done(ModbusRequest* request, void* context)
+{
+    Pending* pending = (Pending*)context;
+    ModbusGateway* gateway = pending->gateway;
+
+    if (!gateway)
+    {
+        delete pending;
+        return;
+    }
+
+    Bus& bus = gateway->buses[pending->bus];
+    if (bus.current == pending)
+        bus.current = NULL;
+
+    unsigned char address = request->frame[0];
+    unsigned char function = request->frame[1];
+
+    //Чтения, поставленные после этой записи, могли выполниться раньше неё
+    if (pending->key.empty())
+        gateway->Forget(address);
+
+    if (request->error >= MODBUS_ERROR_TIMEOUT)
+    {
+        for (unsigned int i = 0; i < pending->waiters.size(); ++i)
+            gateway->ReplyError(pending->waiters[i], address, function, MODBUS_EXCEPTION_TARGET_FAILED);
+    }
+    else if (request->responseSize > 2)
+    {
+        //Ответ без CRC; исключения slave-устройства передаются клиенту как есть
+        unsigned int size = request->responseSize - 2;
+
+        if (!request->error && !pending->key.empty() && gateway->config.cacheTtlUs > 0
+                && pending->generation == gateway->generations[address])
+        {
+            CacheEntry& entry = gateway->cache[pending->key];
+            entry.response.assign(request->response, request->response + size);
+            entry.expires = ModbusLoop::Now() + gateway->config.cacheTtlUs;
+            entry.generation = pending->generation;
+
+            if (gateway->cache.size() > gateway->config.maxCacheEntries)
+                gateway->Expire();
+        }
+
+        for (unsigned int i = 0; i < pending->waiters.size(); ++i)
+            gateway->Reply(pending->waiters[i], request->response, size);
+    }
+
+    unsigned int index = pending->bus;
+    gateway->Release(pending);
+    gateway->Dispatch(index);
+}
+
+
+void ModbusGateway::Expire()
+{
+    long long now = ModbusLoop::Now();
+
+    for (std::unordered_map<std::string, CacheEntry>::iterator it = cache.begin(); it != cache.end(); )
+    {
+        if (it->second.expires <= now || it->second.generation != generations[(unsigned char)it->first[0]])
+            it = cache.erase(it);
+        else
+            ++it;
+    }
+
+    //Все ответы ещё свежие - кэш очищается целиком, чтобы не расти без предела
+    if (cache.size() > config.maxCacheEntries)
+        cache.clear();
+}
+
+
+void ModbusGateway::Reply(const Waiter& waiter, const unsigned char* frame, unsigned int size)
+{
+    std::unordered_map<unsigned long long, Connection>::iterator it = connections.find(waiter.connection);
+    if (it == connections.end())
+        return;
+
+    //Заголовок MBAP: транзакция, протокол 0, длина, адрес устройства из запроса
+    std::vector<unsigned char>& output = it->second.output;
+    output.push_back(waiter.transaction >> 8);
+    output.push_back(waiter.transaction & 0xFFU);
+    output.push_back(0);
+    output.push_back(0);
+    output.push_back(size >> 8);
+    output.push_back(size & 0xFFU);
+    output.push_back(waiter.unit);
+    output.insert(output.end(), frame + 1, frame + size);
+
+    if (!it->second.parsing)
+        Flush(waiter.connection);
+}
+
+
+void ModbusGateway::ReplyError(const Waiter& waiter, unsigned char address, unsigned char function, unsigned char code)
+{
+    unsigned char* error = CreateErrorBuffer(address, function, code);
+    Reply(waiter, error, 3);
+    free(error);
+}
+
+
+void ModbusGateway::Flush(unsigned long long id)
+{
+    std::unordered_map<unsigned long long, Connection>::iterator it = connections.find(id);
+    if (it == connections.end())
+        return;
+
+    Connection& connection = it->second;
+    if (!connection.output.empty())
+    {
+        ssize_t sent = write(connection.fd, connection.output.data(), connection.output.size());
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            Drop(id);
+            return;
+        }
+
+        if (sent > 0)
+            connection.output.erase(connection.output.begin(), connection.output.begin() + sent);
+    }
+
+    loop.SetEvents(connection.fd, connection.output.empty() ? POLLIN : (POLLIN | POLLOUT));
+}
@@ -0,0 +1,153 @@
+#ifndef MODBUS_GATEWAY_H
+#define MODBUS_GATEWAY_H
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "modbus_client.h"
+#include "modbus_general.h"
+
+/*
+    Шлюз Modbus TCP - RTU.
+
+    Принимает подключения Modbus TCP и передаёт запросы на шины RTU
+    (ModbusClient поверх последовательного порта, pty или виртуальной
+    линии ModbusLine). Шина выбирается по полю unit заголовка MBAP.
+
+    У каждой шины для каждого клиента своя очередь, запросы на линию
+    выбираются из очередей по кругу, поэтому клиент с длинной очередью
+    не задерживает остальных. На шине одновременно выполняется один
+    запрос.
+
+    Одинаковые чтения (функции 0x03, 0x04 с теми же адресом устройства,
+    регистром и количеством) от разных клиентов, ожидающие в очереди
+    или уже отправленные на линию, объединяются в один запрос, а ответ
+    рассылается всем. Успешные ответы на чтение хранятся в кэше
+    cacheTtlUs микросекунд; запись в устройство сбрасывает кэш и
+    объединение чтений этого устройства.
+
+    Входящие кадры проверяются IsValidBufferSizeFromMaster (после
+    приведения к виду RTU), ответы шины - IsValidBufferSizeFromSlave
+    в ModbusClient. Ошибки шины возвращаются клиенту исключениями:
+    0x0A - нет шины для устройства, 0x0B - устройство не ответило,
+    0x06 - очередь клиента переполнена.
+*/
+
+//Коды исключений шлюза (общие для slave-устройств - в modbus_general.h)
+#define MODBUS_EXCEPTION_BUSY               (0x06)
+#define MODBUS_EXCEPTION_PATH_UNAVAILABLE   (0x0A)
+#define MODBUS_EXCEPTION_TARGET_FAILED      (0x0B)
+
+//Параметры шлюза
+struct ModbusGatewayConfig
+{
+    long long cacheTtlUs = 100000;      //время жизни ответа в кэше (0 - кэш выключен)
+    unsigned int maxQueued = 64;        //предел запросов клиента в очереди одной шины
+    unsigned int maxCacheEntries = 65536;//размер кэша, после которого удаляются устаревшие ответы
+};
+
+
+class ModbusGateway
+{
+    //Получатель ответа: подключение и номер транзакции MBAP
+    struct Waiter
+    {
+        unsigned long long connection;
+        unsigned short transaction;
+        unsigned char unit;
+    };
+
+    //Запрос на шину, возможно объединяющий несколько одинаковых чтений
+    struct Pending
+    {
+        ModbusRequest request;
+        ModbusGateway* gateway;
+        unsigned int bus;
+        std::string key;                //кадр без CRC, для объединения и кэша (пусто - запись)
+        unsigned long long generation;  //поколение кэша устройства на момент постановки
+        std::vector<Waiter> waiters;
+    };
+
+    //Шина RTU со справедливой очередью по клиентам
+    struct Bus
+    {
+        ModbusClient* client;
+        std::unordered_map<unsigned long long, std::deque<Pending*>> queues;
+        std::deque<unsigned long long> order;   //клиенты с непустой очередью, по кругу
+        Pending* current;                       //запрос на линии
+    };
+
+    //Подключение клиента Modbus TCP
+    struct Connection
+    {
+        int fd;
+        std::vector<unsigned char> input;
+        std::vector<unsigned char> output;
+        bool parsing;                   //идёт разбор входных данных, ответы отправляются после него
+    };
+
+    //Ответ в кэше
+    struct CacheEntry
+    {
+        std::vector<unsigned char> response;    //кадр RTU без CRC
+        long long expires;
+        unsigned long long generation;
+    };
+
+    ModbusLoop& loop;
+    ModbusGatewayConfig config;
+    int listener;
+
+    std::vector<Bus> buses;
+    int routes[256];                            //шина для каждого адреса устройства (-1 - нет)
+
+    std::unordered_map<unsigned long long, Connection> connections;
+    unsigned long long nextConnection;
+
+    std::unordered_map<std::string, Pending*> reads;    //объединяемые чтения
+    std::unordered_map<std::string, CacheEntry> cache;
+    unsigned long long generations[256];        //поколение кэша устройства, растёт при каждой записи
+
+    //Статистика
+    unsigned long long requests;
+    unsigned long long forwarded;
+    unsigned long long merged;
+    unsigned long long cached;
+    unsigned long long rejected;
+
+    void OnAccept();
+    void OnReady(unsigned long long id, short revents);
+    void OnRequest(unsigned long long id, const unsigned char* mbap, unsigned int size);
+    void Reply(const Waiter& waiter, const unsigned char* frame, unsigned int size);
+    void Release(Pending* pending);
+    void ReplyError(const Waiter& waiter, unsigned char address, unsigned char function, unsigned char code);
+    void Flush(unsigned long long id);
+    void Drop(unsigned long long id);
+    void Dispatch(unsigned int bus);
+    void Forget(unsigned char address);
+    void Expire();
+    static void Done(ModbusRequest* request, void* context);
+public:
+    ModbusGateway(ModbusLoop& loop, const ModbusGatewayConfig& config = ModbusGatewayConfig());
+    ~ModbusGateway();
+
+    //Принимать подключения на порту port (host - адрес интерфейса, NULL - все)
+    bool Listen(unsigned short port, const char* host = NULL);
+    void Close();
+
+    //Добавить шину, возвращает её номер
+    unsigned int AddBus(ModbusClient* client);
+
+    //Направлять запросы к устройствам с адресами first..last на шину bus
+    void Route(unsigned char first, unsigned char last, unsigned int bus);
+
+    unsigned int Connections() const { return connections.size(); }
+    unsigned long long Requests() const { return requests; }    //принято запросов
+    unsigned long long Forwarded() const { return forwarded; }  //отправлено на шины
+    unsigned long long Merged() const { return merged; }        //присоединено к одинаковому чтению
+    unsigned long long Cached() const { return cached; }        //отвечено из кэша
+    unsigned long long Rejected() const { return rejected; }    //отклонено шлюзом
+};
+
+#endif // MODBUS_GATEWAY_H
@@ -1,4 +1,5 @@
 #include "modbus_general.h"
+#include "modbus_slave.h"
 #include "string.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,30 +8,53 @@
 #define COMMAND buffer[1]
 
 
+//Таблица CRC16 (полином 0xA001) для обработки кадра по байту, а не по биту
+static const unsigned short CRC16Table[256] =
+{
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+
 /*Вычисляет CRC16 по массиву указанного размера
 (алгоритм взят из протокола связи вычислителя ВКТ-5 с системой верхнего уровня)*/
 unsigned short CRC16(unsigned char* buffer, unsigned int size)
 {
-    union
-    {
-        unsigned char arr[2];
-        unsigned short value;
-    } sum;
-    unsigned char shiftCount, *ptr;
-    ptr = buffer;
-    sum.value=0xFFFFU;
-    for(; size>0; size--)
-    {
-        sum.value=(unsigned short)((sum.value/256U)*256U+((sum.value%256U)^(*ptr++)));
-        for(shiftCount=0; shiftCount<8; shiftCount++)
-        {
-            if((sum.value&0x1)==1)
-                sum.value=(unsigned short)((sum.value>>1)^0xA001U);
-            else
-                sum.value>>=1;
-        }
-    }
-    return sum.value;
+    unsigned short sum = 0xFFFFU;
+    for (; size>0; size--)
+        sum = (unsigned short)((sum >> 8) ^ CRC16Table[(sum ^ *buffer++) & 0xFFU]);
+
+    return sum;
 }
 
 
@@ -102,6 +126,25 @@ unsigned char* CreateErrorBuffer(unsigned char address, unsigned char command, u
 }
 
 
+//Доступ к памяти slave-устройства через функции read и write
+struct FunctionMemory
+{
+    unsigned char (*read)(unsigned char*, unsigned char*, unsigned char);
+    unsigned char (*write)(unsigned char*, unsigned char*, unsigned char);
+    unsigned char* memory;
+
+    unsigned char Read(unsigned char* dest, unsigned int offset, unsigned int size)
+    {
+        return read(dest, memory + offset, (unsigned char)(size / 2));
+    }
+
+    unsigned char Write(unsigned int offset, const unsigned char* src, unsigned int size)
+    {
+        return write(memory + offset, (unsigned char*)src, (unsigned char)(size / 2));
+    }
+};
+
+
 /*Обработка принятого кадра slave-устройством и формирование кадра-ответа
 (Выделяет память, которую нужно потом освободить!)
 
@@ -124,159 +167,8 @@ unsigned char* SlaveProcess
     char isHighLowOrder                         //порядок следования байтов в области записываемых значений (по умолчанию LowHigh)
 )
 {
-    //проверка длины и CRC
-    if (!IsValidBufferSizeFromMaster(buffer, bufferSize))
-    {
-        resultBufferSize = 0;
-        return NULL;
-    }
-
-
-    //Проверка правильности адреса устройства
-    if (SLAVE_ADDRESS != slaveAddress && SLAVE_ADDRESS != 0)
-    {
-        resultBufferSize = 0;
-        return NULL;
-    }
-
-    unsigned char* result;
-
-    //Проверка кода функции
-    //если неверный, то код ошибки 0x01
-    if (COMMAND != 0x03 && COMMAND != 0x04 && COMMAND != 0x06 && COMMAND != 0x10)
-    {
-        resultBufferSize = 5;
-        result = CreateErrorBuffer(SLAVE_ADDRESS, COMMAND, 0x01);
-
-        return result;
-    }
-
-    //Проверка адреса регистра
-    //Если неверный, то код ошибки 0x02
-    if ((buffer[2]<<8 | buffer[3] > totalRegistersSize)
-            || (COMMAND == 0x10 && (buffer[2]<<8|buffer[3]) + buffer[6] > totalRegistersSize)
-            || ((COMMAND == 0x03 || COMMAND == 0x04) && (buffer[2]<<8|buffer[3]) + (buffer[4]<<1|buffer[5])*2 > totalRegistersSize))
-    {
-        resultBufferSize = 5;
-        result = CreateErrorBuffer(SLAVE_ADDRESS, COMMAND, 0x02);
-
-        return result;
-    }
-
-    //Все ошибки, что мог, обработал
-    unsigned char errorCode;
-    switch(COMMAND)
-    {
-    case 0x03:
-    case 0x04:
-        //Если slave-адрес в пришедшем кадре широковещательный, то отвечать не нужно
-        if (SLAVE_ADDRESS == 0)
-        {
-            resultBufferSize = 0;
-            return NULL;
-        }
-
-        //В противном случае формируется кадр-ответ
-        resultBufferSize = (buffer[4]<<8 | buffer[5]) * 2 + 5;
-
-        result = (unsigned char*)malloc(resultBufferSize);
-        errorCode = read(result+3, firstRegister+(buffer[2]<<8 | buffer[3]), buffer[4]<<8 | buffer[5]);
-
-        //Если функция чтения значений регистров вернула ошибку, то формируется кадр ошибки
-        if (errorCode)
-        {
-            free(result);
-
-            resultBufferSize = 5;
-
-            return CreateErrorBuffer(SLAVE_ADDRESS, COMMAND, errorCode);
-        }
-
-        //Если указан порядок следования байтов HighLow, то необходимо
-        //поменять местами байты в прочитанных значениях регистров
-        if(isHighLowOrder)
-        {
-            ChangeByteOrder(result+3, (buffer[4]<<8 | buffer[5])*2);
-        }
-        result[0] = SLAVE_ADDRESS;
-        result[1] = COMMAND;
-        result[2] = (buffer[4]<<8 | buffer[5]) * 2;
-
-        break;
-
-    case 0x06:
-        /*Если указан порядок следования байтов HighLow, то необходимо
-        поменять местами байты в значении, которое записывается в указанный регистр*/
-        if (isHighLowOrder)
-        {
-            unsigned short tmp = buffer[4] << 8 | buffer[5];
-            errorCode = write(firstRegister + (buffer[2]<<8 | buffer[3]), (unsigned char*)&tmp, 1);
-        }
-        //Иначе просто записывается пришедшее значение
-        else
-        {
-            errorCode = write(firstRegister + (buffer[2]<<8 | buffer[3]), buffer+4, 1);
-        }
-
-        //Если slave-адрес в пришедшем кадре широковещательный, то отвечать не нужно
-        if (SLAVE_ADDRESS == 0)
-        {
-            resultBufferSize = 0;
-            return NULL;
-        }
-
-        //Если функция записи значения в регистр вернула ошибку, то формируется кадр ошибки
-        if (errorCode)
-        {
-            resultBufferSize = 5;
-
-            return CreateErrorBuffer(SLAVE_ADDRESS, COMMAND, errorCode);
-        }
-
-        //Для этой команды ответ совпадает с пришедшим кадром
-        resultBufferSize = bufferSize;
-        result = (unsigned char*)malloc(resultBufferSize);
-        memcpy(result, buffer, 6);
-
-        break;
-
-    case 0x10:
-        /*Если указан порядок следования байтов HighLow, то необходимо
-        поменять местами байты в значения, которое записываются в регистры*/
-        if (isHighLowOrder)
-        {
-            ChangeByteOrder(buffer+7, buffer[6]);
-        }
-
-        unsigned char errorCode = write(firstRegister + (buffer[2]<<8 | buffer[3]), buffer+7, buffer[6]/2);
-
-        //Если slave-адрес в пришедшем кадре широковещательный, то отвечать не нужно
-        if (SLAVE_ADDRESS == 0)
-        {
-            resultBufferSize = 0;
-            return NULL;
-        }
-
-        //Если функция записи значения в регистр вернула ошибку, то формируется кадр ошибки
-        if (errorCode)
-        {
-            resultBufferSize = 5;
-
-            return CreateErrorBuffer(SLAVE_ADDRESS, COMMAND, errorCode);
-        }
-
-        resultBufferSize = 8;
-        result = (unsigned char*)malloc(resultBufferSize);
-
-        memcpy(result, buffer, 6);
-
-        break;
-    }
-
-    //В конец кадра добавляется CRC
-    *(unsigned short*)(result + resultBufferSize - 2) = CRC16(result, resultBufferSize - 2);
-
-    return result;
+    FunctionMemory memory = { read, write, firstRegister };
+    return SlaveProcessT(buffer, bufferSize, resultBufferSize, slaveAddress, memory, totalRegistersSize, isHighLowOrder);
 }
 
 
@@ -364,7 +256,7 @@ unsigned char* CreateBufferWriteSingleHoldingRegister
 
     unsigned char* buffer = (unsigned char*)malloc(bufferSize);
     buffer[0] = slaveAddress;
-    buffer[1] = 0x10;
+    buffer[1] = 0x06;
     buffer[2] = paramAddress >> 8;
     buffer[3] = paramAddress & 0xFFU;
 
@@ -411,8 +303,8 @@ unsigned char* CreateBufferWriteMultipleHoldingRegisters
     buffer[1] = 0x10;
     buffer[2] = firstParamAddress >> 8;
     buffer[3] = firstParamAddress & 0xFFU;
-    buffer[4] = countRegisters & 0xFFU;
-    buffer[5] = countRegisters >> 8;
+    buffer[4] = countRegisters >> 8;
+    buffer[5] = countRegisters & 0xFFU;
     buffer[6] = countBytes;
 
     for (unsigned char i=0; i < countBytes/2; ++i)
@@ -7,10 +7,26 @@ unsigned short CRC16(unsigned char* buffer, unsigned int size);
 
 
 
+//Коды исключений Modbus, которые формирует slave-устройство
+#define MODBUS_EXCEPTION_ILLEGAL_FUNCTION   (0x01)  //команда не поддерживается
+#define MODBUS_EXCEPTION_ILLEGAL_ADDRESS    (0x02)  //недопустимый адрес или запись в защищённый регистр
+#define MODBUS_EXCEPTION_ILLEGAL_VALUE      (0x03)  //недопустимое количество регистров
+
+
 //Проверяет корректность кадра, принятого slave-устройством
 char IsValidBufferSizeFromMaster(unsigned char* buffer, unsigned int size);
 
 
+//Изменение порядка следования байтов в каждом двухбайтовом значении массива
+void ChangeByteOrder(unsigned char* buffer, unsigned int size);
+
+
+/*Создание кадра ошибки с кодом исключения errorCode
+
+(Выделяет память, которую нужно потом освободить!)*/
+unsigned char* CreateErrorBuffer(unsigned char address, unsigned char command, unsigned char errorCode);
+
+
 /*Обработка принятого кадра slave-устройством и формирование кадра-ответа
 (Выделяет память, которую нужно потом освободить!)
 
@@ -18,7 +34,11 @@ char IsValidBufferSizeFromMaster(unsigned char* buffer, unsigned int size);
 unsigned char read(unsigned char* dest, unsigned char* src, unsigned char countRegisters);
 
 Функция write должна иметь вид:
-unsigned char write(unsigned char* dest, unsigned char* src, unsigned char countRegisters);*/
+unsigned char write(unsigned char* dest, unsigned char* src, unsigned char countRegisters);
+
+Адрес регистра в кадре - смещение в байтах от firstRegister, он должен быть чётным.
+Функции вызываются по указателю на каждый запрос; там, где устройство известно
+при компиляции, лучше использовать SlaveProcessT (modbus_slave.h).*/
 unsigned char* SlaveProcess
 (
     unsigned char* buffer,                      //принятый кадр
@@ -29,6 +49,7 @@ unsigned char* SlaveProcess
     unsigned char (*write)(unsigned char*, unsigned char*, unsigned char),//функция записи данных в память slave-устройства
     unsigned char* firstRegister,               //указатель на начало регистровой памяти в slave-устройстве
     unsigned short totalRegistersSize = 0xFFFFU,//общее количество регистров (все регистры полагаются двухбайтовыми,
+                                                //размер памяти - 2*totalRegistersSize байт,
                                                 //по умолчанию размер памяти принимается максимально возможным)
     char isHighLowOrder = 0                     //порядок следования байтов в области записываемых значений (по умолчанию LowHigh)
 );
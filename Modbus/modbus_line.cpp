@@ -0,0 +1,362 @@
+#include "modbus_line.h"
+#include "modbus_slave.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+ModbusLine::ModbusLine(ModbusLoop& loop, const ModbusLineConfig& config):
+    loop(loop),
+    config(config),
+    fd(-1),
+    peer(-1),
+    handler(ProcessSlaves),
+    context(this),
+    faults(NULL),
+    bus(0),
+    frames(0),
+    requestSize(0),
+    wireFree(0),
+    responseEnd(0),
+    processTimer(0),
+    requests(0),
+    responses(0),
+    collisions(0),
+    busyTime(0)
+{
+    ptyPath[0] = 0;
+}
+
+
+ModbusLine::~ModbusLine()
+{
+    Close();
+}
+
+
+int ModbusLine::OpenSocket()
+{
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+        return -1;
+
+    if (!Attach(pair[0], -1))
+    {
+        close(pair[1]);
+        return -1;
+    }
+
+    //Дескриптор master принадлежит тому, кто его получил
+    return pair[1];
+}
+
+
+const char* ModbusLine::OpenPty()
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0)
+        return NULL;
+
+    if (grantpt(master) < 0 || unlockpt(master) < 0 || ptsname_r(master, ptyPath, sizeof(ptyPath)) != 0)
+    {
+        close(master);
+        return NULL;
+    }
+
+    /*Подчинённая сторона держится открытой, чтобы линия не получала EIO
+    между подключениями внешнего master, и переводится в "сырой" режим*/
+    int slave = open(ptyPath, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    {
+        close(master);
+        return NULL;
+    }
+
+    termios tty;
+    if (tcgetattr(slave, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        tcsetattr(slave, TCSANOW, &tty);
+    }
+
+    if (!Attach(master, slave))
+    {
+        close(slave);
+        return NULL;
+    }
+
+    return ptyPath;
+}
+
+
+bool ModbusLine::Attach(int fd, int peer)
+{
+    Close();
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    this->fd = fd;
+    this->peer = peer;
+    requestSize = 0;
+
+    loop.Watch(fd, POLLIN, [this](short revents)
+    {
+        if (revents & POLLIN)
+            OnInput();
+        else if (revents & (POLLERR | POLLNVAL))
+            Close();
+    });
+
+    return true;
+}
+
+
+void ModbusLine::Close()
+{
+    if (processTimer)
+    {
+        loop.CancelTimer(processTimer);
+        processTimer = 0;
+    }
+
+    for (unsigned int i = 0; i < deliveries.size(); ++i)
+        loop.CancelTimer(deliveries[i]);
+    deliveries.clear();
+
+    if (fd >= 0)
+    {
+        loop.Unwatch(fd);
+        close(fd);
+        fd = -1;
+    }
+
+    if (peer >= 0)
+    {
+        close(peer);
+        peer = -1;
+    }
+}
+
+
+void ModbusLine::SetHandler(ModbusLineHandler handler, void* context)
+{
+    this->handler = handler;
+    this->context = context;
+}
+
+
+void ModbusLine::SetFaults(ModbusFaults* faults, unsigned int bus)
+{
+    this->faults = faults;
+    this->bus = bus;
+    frames = 0;
+}
+
+
+void ModbusLine::AddSlave(unsigned char address, unsigned char* memory, unsigned short totalRegisters, char isHighLowOrder,
+                          ModbusWritable writable, void* writableContext)
+{
+    Slave slave;
+    slave.address = address;
+    slave.memory = memory;
+    slave.totalRegisters = totalRegisters;
+    slave.isHighLowOrder = isHighLowOrder;
+    slave.writable = writable;
+    slave.writableContext = writableContext;
+
+    slaves.push_back(slave);
+}
+
+
+unsigned char* ModbusLine::ProcessSlaves(void* context, unsigned char* frame, unsigned int size, unsigned int& responseSize)
+{
+    ModbusLine* line = (ModbusLine*)context;
+    responseSize = 0;
+
+    if (size < 1)
+        return NULL;
+
+    //Широковещательный кадр обрабатывают все устройства, ответа нет
+    for (unsigned int i = 0; i < line->slaves.size(); ++i)
+    {
+        Slave& slave = line->slaves[i];
+        if (frame[0] != 0 && frame[0] != slave.address)
+            continue;
+
+        //SlaveProcessT может изменить порядок байтов в кадре, поэтому каждому устройству - своя копия
+        unsigned char copy[MODBUS_MAX_FRAME];
+        memcpy(copy, frame, size);
+
+        ModbusCheckedMemory memory(slave.memory, slave.writable, slave.writableContext);
+        unsigned char* response = SlaveProcessT(copy, size, responseSize, slave.address, memory,
+                                                slave.totalRegisters, slave.isHighLowOrder);
+        if (frame[0] != 0)
+            return response;
+
+        free(response);
+        responseSize = 0;
+    }
+
+    return NULL;
+}
+
+
+void ModbusLine::OnInput()
+{
+    unsigned char buffer[MODBUS_MAX_FRAME];
+
+    for (;;)
+    {
+        ssize_t received = read(fd, buffer, sizeof(buffer));
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            break;
+
+        //Master отключился: для pty это EIO, пока подчинённая сторона никем не открыта
+        if (received <= 0)
+        {
+            if (peer < 0)
+                Close();
+            break;
+        }
+
+        long long now = ModbusLoop::Now();
+        long long charTime = config.CharTime();
+
+        for (ssize_t i = 0; i < received; ++i)
+        {
+            //Линия полудуплексная: передача master во время ответа - коллизия
+            if (now < responseEnd)
+                ++collisions;
+
+            long long start = now > wireFree ? now : wireFree;
+            wireFree = start + charTime;
+            busyTime += charTime;
+
+            //Байты сверх максимального размера кадра занимают линию, но не попадают в кадр
+            if (requestSize < MODBUS_MAX_FRAME)
+                request[requestSize++] = buffer[i];
+        }
+    }
+
+    if (!requestSize)
+        return;
+
+    //Slave-устройство считает кадр законченным после t3.5 тишины в линии
+    if (processTimer)
+        loop.CancelTimer(processTimer);
+    processTimer = loop.AddTimer(wireFree + config.FrameGap(), [this]() { processTimer = 0; Process(); });
+}
+
+
+void ModbusLine::Process()
+{
+    unsigned char frame[MODBUS_MAX_FRAME];
+    unsigned int size = requestSize;
+    memcpy(frame, request, size);
+    requestSize = 0;
+
+    ++requests;
+
+    ModbusFaultDecision decision;
+    decision.fault = FAULT_NONE;
+    decision.parameter = 0;
+
+    if (faults)
+        decision = faults->Decide(bus, frame[0], frames++);
+
+    //Искажённый бит ломает CRC, и slave-устройство отбрасывает кадр в IsValidBufferSizeFromMaster
+    if (decision.fault == FAULT_BIT_ERROR)
+    {
+        unsigned int bit = decision.parameter % (size * 8);
+        frame[bit / 8] ^= (unsigned char)(1U << (bit % 8));
+    }
+
+    unsigned char address = frame[0];
+    unsigned char command = size > 1 ? frame[1] : 0;
+
+    unsigned int responseSize = 0;
+    unsigned char* response = handler(context, frame, size, responseSize);
+
+    //Неисправности ответа вносятся только туда, где ответ был
+    if (!response && decision.fault != FAULT_BIT_ERROR)
+        decision.fault = FAULT_NONE;
+
+    if (faults)
+        faults->Count(decision.fault);
+
+    if (!response)
+        return;
+
+    long long delay = 0;
+    switch (decision.fault)
+    {
+    case FAULT_DROP:
+        free(response);
+        return;
+
+    case FAULT_LATE:
+        delay = faults->LateUs(address);
+        break;
+
+    case FAULT_FAILURE:
+    case FAULT_BUSY:
+        //Запрос обработан, но вместо ответа передаётся исключение
+        free(response);
+        response = CreateErrorBuffer(address, command, decision.fault == FAULT_BUSY ? 0x06 : 0x04);
+        responseSize = 5;
+        break;
+
+    case FAULT_TRUNCATE:
+        if (responseSize > 1)
+            responseSize = 1 + decision.parameter % (responseSize - 1);
+        break;
+
+    default:
+        break;
+    }
+
+    ++responses;
+
+    //Время ответа считается по модели линии, а не по моменту срабатывания таймера
+    long long start = wireFree + config.FrameGap() + config.turnaroundUs + delay;
+
+    Deliver(response, responseSize, start);
+    free(response);
+}
+
+
+void ModbusLine::Deliver(const unsigned char* frame, unsigned int size, long long start)
+{
+    long long charTime = config.CharTime();
+    unsigned int chunk = config.deliveryChunk ? config.deliveryChunk : size;
+
+    //Части длиннее MaxChunk разделили бы кадр паузой t3.5, и master отбросил бы его
+    if (config.deliveryChunk && chunk > config.MaxChunk())
+        chunk = config.MaxChunk();
+
+    //Каждая часть кадра доставляется в момент, когда по линии прошёл её последний байт
+    for (unsigned int i = 0; i < size; i += chunk)
+    {
+        unsigned int count = size - i < chunk ? size - i : chunk;
+        std::vector<unsigned char> part(frame + i, frame + i + count);
+
+        //Части ответов одной линии срабатывают в порядке постановки, поэтому снимаются с начала очереди
+        deliveries.push_back(loop.AddTimer(start + (i + count) * charTime, [this, part]()
+        {
+            deliveries.pop_front();
+
+            //Ответ, не поместившийся в буфер master, теряется, как на реальной линии
+            if (fd >= 0 && write(fd, part.data(), part.size()) < 0)
+                return;
+        }));
+    }
+
+    wireFree = start + size * charTime;
+    responseEnd = wireFree;
+    busyTime += size * charTime;
+}
@@ -0,0 +1,147 @@
+#ifndef MODBUS_LINE_H
+#define MODBUS_LINE_H
+
+#include <deque>
+#include <vector>
+#include "modbus_client.h"
+#include "modbus_faults.h"
+#include "modbus_slave.h"
+
+/*
+    Модель линии RS-485 с учётом скорости передачи.
+
+    Каждая ModbusLine - одна виртуальная шина: master подключается к ней
+    через дескриптор (OpenSocket, для ModbusClient в том же процессе) или
+    через псевдотерминал (OpenPty, для внешних программ опроса), slave-
+    устройства отвечают через SlaveProcessT.
+
+    Каждый байт занимает линию на время передачи символа (старт, данные,
+    чётность, стоп). Кадр запроса считается принятым после t3.5 тишины,
+    ответ начинается через время подготовки ответа и доставляется master
+    не раньше, чем его байты прошли бы по реальной линии. Доставка
+    планируется таймерами ModbusLoop, а не задержкой на каждом байте,
+    поэтому один поток обслуживает тысячи линий.
+
+    К линии можно подключить ModbusFaults: тогда часть кадров искажается,
+    теряется, опаздывает, обрезается или получает ответ-исключение.
+*/
+
+//Параметры линии
+struct ModbusLineConfig
+{
+    unsigned int baud = 9600;           //скорость, бит/с
+    unsigned char dataBits = 8;         //бит данных
+    char parity = 'E';                  //чётность: 'N', 'E' или 'O'
+    unsigned char stopBits = 1;         //стоповых бит
+    long long turnaroundUs = 5000;      //время подготовки ответа slave-устройством
+    unsigned int deliveryChunk = 0;     //доставлять ответ частями по столько байт (0 - кадр целиком, см. MaxChunk)
+
+    //Бит на символ вместе со стартовым
+    unsigned char BitsPerChar() const { return 1 + dataBits + (parity != 'N') + stopBits; }
+    long long CharTime() const { return ModbusCharTime(baud, BitsPerChar()); }
+    long long FrameGap() const { return ModbusFrameGap(baud, BitsPerChar()); }
+
+    /*Наибольшая часть ответа, после которой master ещё не примет паузу за конец
+    кадра: между доставками частей проходит время их передачи, и оно должно
+    быть меньше t3.5 с запасом в полсимвола (3 байта на 9600, 17 на 115200)*/
+    unsigned int MaxChunk() const
+    {
+        long long chunk = (FrameGap() - CharTime() / 2) / CharTime();
+        return chunk > 1 ? (unsigned int)chunk : 1;
+    }
+};
+
+
+/*Обработчик кадра, принятого slave-устройствами линии
+(возвращает кадр-ответ, выделенный malloc, или NULL, если ответа нет)
+
+Функция должна иметь вид:
+unsigned char* handler(void* context, unsigned char* frame, unsigned int size, unsigned int& responseSize);*/
+typedef unsigned char* (*ModbusLineHandler)(void*, unsigned char*, unsigned int, unsigned int&);
+
+
+class ModbusLine
+{
+    //Slave-устройство, отвечающее по памяти регистров
+    struct Slave
+    {
+        unsigned char address;
+        unsigned char* memory;
+        unsigned short totalRegisters;
+        char isHighLowOrder;
+        ModbusWritable writable;
+        void* writableContext;
+    };
+
+    ModbusLoop& loop;
+    ModbusLineConfig config;
+
+    int fd;                             //сторона линии, к которой подключён master
+    int peer;                           //сторона master (сокет или подчинённая сторона pty)
+    char ptyPath[64];
+
+    ModbusLineHandler handler;
+    void* context;
+    std::vector<Slave> slaves;
+
+    //Внесение неисправностей (может отсутствовать)
+    ModbusFaults* faults;
+    unsigned int bus;                   //номер шины для генератора решений
+    unsigned long long frames;          //номер следующего кадра на шине
+
+    //Состояние линии
+    unsigned char request[MODBUS_MAX_FRAME];
+    unsigned int requestSize;
+    long long wireFree;                 //момент освобождения линии
+    long long responseEnd;              //момент окончания передачи последнего ответа
+    unsigned long long processTimer;    //таймер t3.5 после последнего байта запроса
+    std::deque<unsigned long long> deliveries;  //таймеры доставки частей ответов
+
+    //Статистика
+    unsigned long long requests;
+    unsigned long long responses;
+    unsigned long long collisions;
+    long long busyTime;
+
+    static unsigned char* ProcessSlaves(void* context, unsigned char* frame, unsigned int size, unsigned int& responseSize);
+
+    bool Attach(int fd, int peer);
+    void OnInput();
+    void Process();
+    void Deliver(const unsigned char* frame, unsigned int size, long long start);
+public:
+    ModbusLine(ModbusLoop& loop, const ModbusLineConfig& config = ModbusLineConfig());
+    ~ModbusLine();
+
+    //Создать пару сокетов, возвращает дескриптор для master (ModbusClient::AttachRtu)
+    int OpenSocket();
+
+    //Создать псевдотерминал, возвращает путь, который открывает внешний master
+    const char* OpenPty();
+
+    void Close();
+
+    //Обрабатывать принятые кадры функцией handler
+    void SetHandler(ModbusLineHandler handler, void* context);
+
+    /*Подключить к линии slave-устройство с адресом address и памятью регистров memory
+    из totalRegisters двухбайтовых регистров; запись разрешается функцией writable
+    (NULL - запись любых регистров, см. IsDeviceWritable для счётчиков)*/
+    void AddSlave(unsigned char address, unsigned char* memory, unsigned short totalRegisters = 0xFFFFU,
+                  char isHighLowOrder = 0, ModbusWritable writable = NULL, void* writableContext = NULL);
+
+    //Вносить неисправности faults, bus - номер шины (разные шины получают разные последовательности решений)
+    void SetFaults(ModbusFaults* faults, unsigned int bus);
+
+    const ModbusLineConfig& Config() const { return config; }
+
+    //Время передачи кадра размером size по линии
+    long long FrameTime(unsigned int size) const { return size * config.CharTime(); }
+
+    unsigned long long Requests() const { return requests; }
+    unsigned long long Responses() const { return responses; }
+    unsigned long long Collisions() const { return collisions; }
+    long long BusyTime() const { return busyTime; }
+};
+
+#endif // MODBUS_LINE_H
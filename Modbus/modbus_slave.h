@@ -0,0 +1,219 @@
+#ifndef MODBUS_SLAVE_H
+#define MODBUS_SLAVE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_general.h"
+
+/*
+    Обработка кадра slave-устройством с доступом к памяти через объект.
+
+    SlaveProcessT делает то же, что SlaveProcess, но вместо функций read
+    и write по указателям вызывает методы объекта memory, которые
+    компилятор встраивает в место вызова. Объект должен иметь методы:
+
+    unsigned char Read(unsigned char* dest, unsigned int offset, unsigned int size);
+    unsigned char Write(unsigned int offset, const unsigned char* src, unsigned int size);
+
+    offset и size - в байтах, результат - код исключения Modbus (0 - успешно).
+    Границы памяти проверяет SlaveProcessT, поэтому методам остаются
+    проверка прав (для Write) и memcpy.
+
+    Адрес регистра в кадре - смещение в байтах от начала памяти (как RG_*),
+    поэтому он должен быть чётным. Размер памяти задаётся в двухбайтовых
+    регистрах, как и количество регистров в кадре.
+*/
+
+#define MODBUS_MAX_READ_REGISTERS   (125)   //Наибольшее количество регистров в чтении
+#define MODBUS_MAX_WRITE_REGISTERS  (123)   //Наибольшее количество регистров в записи
+
+
+//Память регистров без ограничений доступа
+struct ModbusMemory
+{
+    unsigned char* memory;
+
+    explicit ModbusMemory(unsigned char* memory): memory(memory) {}
+
+    unsigned char Read(unsigned char* dest, unsigned int offset, unsigned int size)
+    {
+        memcpy(dest, memory + offset, size);
+        return 0;
+    }
+
+    unsigned char Write(unsigned int offset, const unsigned char* src, unsigned int size)
+    {
+        memcpy(memory + offset, src, size);
+        return 0;
+    }
+};
+
+
+/*Проверка прав записи диапазона [offset, offset+size) байт памяти memory
+(права могут зависеть от её содержимого, например от флагов устройства)
+
+Функция должна иметь вид:
+bool writable(const unsigned char* memory, unsigned int offset, unsigned int size, void* context);*/
+typedef bool (*ModbusWritable)(const unsigned char*, unsigned int, unsigned int, void*);
+
+//Память регистров с проверкой прав записи (writable = NULL - без ограничений)
+struct ModbusCheckedMemory
+{
+    unsigned char* memory;
+    ModbusWritable writable;
+    void* context;
+
+    ModbusCheckedMemory(unsigned char* memory, ModbusWritable writable, void* context):
+        memory(memory), writable(writable), context(context) {}
+
+    unsigned char Read(unsigned char* dest, unsigned int offset, unsigned int size)
+    {
+        memcpy(dest, memory + offset, size);
+        return 0;
+    }
+
+    unsigned char Write(unsigned int offset, const unsigned char* src, unsigned int size)
+    {
+        if (writable && !writable(memory, offset, size, context))
+            return MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+
+        memcpy(memory + offset, src, size);
+        return 0;
+    }
+};
+
+
+//Дописывание CRC в конец кадра размером size (CRC занимает последние два байта)
+inline void AppendCRC16(unsigned char* buffer, unsigned int size)
+{
+    unsigned short crc = CRC16(buffer, size - 2);
+    buffer[size - 2] = crc & 0xFFU;
+    buffer[size - 1] = crc >> 8;
+}
+
+
+/*Обработка принятого кадра slave-устройством и формирование кадра-ответа
+(Выделяет память, которую нужно потом освободить!)*/
+template<typename Accessor>
+unsigned char* SlaveProcessT
+(
+    unsigned char* buffer,                      //принятый кадр
+    unsigned int bufferSize,                    //размер принятого кадра
+    unsigned int& resultBufferSize,             //размер кадра-ответа (выходной параметр)
+    unsigned char slaveAddress,                 //адрес slave-устройства
+    Accessor& memory,                           //доступ к памяти регистров slave-устройства
+    unsigned short totalRegisters = 0xFFFFU,    //общее количество двухбайтовых регистров
+    char isHighLowOrder = 0                     //порядок следования байтов в области значений (по умолчанию LowHigh)
+)
+{
+    resultBufferSize = 0;
+
+    //Проверка длины, CRC и адреса устройства
+    if (!IsValidBufferSizeFromMaster(buffer, bufferSize))
+        return NULL;
+
+    unsigned char address = buffer[0];
+    unsigned char command = buffer[1];
+    if (address != slaveAddress && address != 0)
+        return NULL;
+
+    //Смещение первого регистра и количество регистров
+    unsigned int offset = buffer[2] << 8 | buffer[3];
+    unsigned int count = command == 0x06 ? 1 : (buffer[4] << 8 | buffer[5]);
+
+    unsigned char errorCode = 0;
+    if (command == 0x03 || command == 0x04)
+    {
+        if (count == 0 || count > MODBUS_MAX_READ_REGISTERS)
+            errorCode = MODBUS_EXCEPTION_ILLEGAL_VALUE;
+    }
+    else if (command == 0x10)
+    {
+        if (count == 0 || count > MODBUS_MAX_WRITE_REGISTERS || buffer[6] != count * 2)
+            errorCode = MODBUS_EXCEPTION_ILLEGAL_VALUE;
+    }
+
+    //Память занимает 2*totalRegisters байт, все величины сравниваются в байтах
+    if (!errorCode && ((offset & 1) || offset + count * 2 > totalRegisters * 2U))
+        errorCode = MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+
+    unsigned char* result = NULL;
+    if (!errorCode)
+    {
+        switch (command)
+        {
+        case 0x03:
+        case 0x04:
+            //На широковещательное чтение не отвечают
+            if (address == 0)
+                return NULL;
+
+            resultBufferSize = count * 2 + 5;
+            result = (unsigned char*)malloc(resultBufferSize);
+
+            errorCode = memory.Read(result + 3, offset, count * 2);
+            if (errorCode)
+            {
+                free(result);
+                result = NULL;
+                break;
+            }
+
+            if (isHighLowOrder)
+                ChangeByteOrder(result + 3, count * 2);
+
+            result[0] = address;
+            result[1] = command;
+            result[2] = (unsigned char)(count * 2);
+            break;
+
+        case 0x06:
+        {
+            //Кадр не меняется: ответ на эту команду - его копия
+            unsigned char value[2] = { buffer[4], buffer[5] };
+            if (isHighLowOrder)
+                ChangeByteOrder(value, 2);
+
+            errorCode = memory.Write(offset, value, 2);
+            if (errorCode || address == 0)
+                break;
+
+            resultBufferSize = 8;
+            result = (unsigned char*)malloc(resultBufferSize);
+            memcpy(result, buffer, 6);
+            break;
+        }
+
+        case 0x10:
+            if (isHighLowOrder)
+                ChangeByteOrder(buffer + 7, count * 2);
+
+            errorCode = memory.Write(offset, buffer + 7, count * 2);
+            if (errorCode || address == 0)
+                break;
+
+            resultBufferSize = 8;
+            result = (unsigned char*)malloc(resultBufferSize);
+            memcpy(result, buffer, 6);
+            break;
+        }
+    }
+
+    //На широковещательные кадры не отвечают даже исключением
+    if (address == 0)
+    {
+        resultBufferSize = 0;
+        return NULL;
+    }
+
+    if (errorCode)
+    {
+        resultBufferSize = 5;
+        return CreateErrorBuffer(address, command, errorCode);
+    }
+
+    AppendCRC16(result, resultBufferSize);
+    return result;
+}
+
+#endif // MODBUS_SLAVE_H
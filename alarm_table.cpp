@@ -0,0 +1,108 @@
+#include "alarm_table.h"
+
+#define N   (0)
+#define A   (ALARM_STATE_ALARM)
+#define R   (ALARM_STATE_REVERSE)
+
+//Таблица переходов: строка - состояние, столбец - событие
+const AlarmTransition AlarmTable[ALARM_STATE_COUNT][EV_COUNT] =
+{
+    //Норма
+    {
+        { A,     1U << F_TP, RG_TP, 0 },    //вскрытие
+        { R,     0,          0,     1 },    //начало противотока
+        { A,     1U << F_MG, RG_MG, 0 },    //сильный магнит
+        { N,     0,          0,     0 },    //магнитная кнопка
+        { N,     0,          0,     1 },    //окончание противотока
+        { N,     0,          0,     0 },    //противоток дольше 30 с (без противотока не возникает)
+    },
+    //Тревога
+    {
+        { A,     1U << F_TP, RG_TP, 0 },
+        { A | R, 0,          0,     1 },
+        { A,     1U << F_MG, RG_MG, 0 },
+        { A,     0,          0,     0 },
+        { A,     0,          0,     1 },
+        { A,     0,          0,     0 },
+    },
+    //Противоток
+    {
+        { A | R, 1U << F_TP, RG_TP, 0 },
+        { R,     0,          0,     0 },    //противоток уже идёт: длительность не сбрасывается
+        { A | R, 1U << F_MG, RG_MG, 0 },
+        { R,     0,          0,     0 },
+        { N,     0,          0,     1 },
+        { A | R, 1U << F_R,  0,     0 },
+    },
+    //Тревога и противоток
+    {
+        { A | R, 1U << F_TP, RG_TP, 0 },
+        { A | R, 0,          0,     0 },
+        { A | R, 1U << F_MG, RG_MG, 0 },
+        { A | R, 0,          0,     0 },
+        { A,     0,          0,     1 },
+        { A | R, 1U << F_R,  0,     0 },
+    },
+};
+
+#undef N
+#undef A
+#undef R
+
+
+//Число дней в месяцах невисокосного года
+static const unsigned char monthDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+
+void MakeDateTime(long long seconds, unsigned char* dateTime)
+{
+    long long days = seconds / 86400;
+    long long rest = seconds % 86400;
+
+    dateTime[0] = (unsigned char)(rest % 60);
+    dateTime[1] = (unsigned char)(rest / 60 % 60);
+    dateTime[2] = (unsigned char)(rest / 3600);
+
+    //Разбор дней от 01.01.2000 на год, месяц и день
+    unsigned int year = 0;
+    for (;;)
+    {
+        unsigned int yearDays = (year % 4 == 0) ? 366 : 365;
+        if (days < yearDays)
+            break;
+        days -= yearDays;
+        ++year;
+    }
+
+    unsigned int month = 0;
+    for (;; ++month)
+    {
+        unsigned int length = monthDays[month] + (month == 1 && year % 4 == 0);
+        if (days < length)
+            break;
+        days -= length;
+    }
+
+    dateTime[3] = (unsigned char)(days + 1);
+    dateTime[4] = (unsigned char)(month + 1);
+    dateTime[5] = (unsigned char)year;
+}
+
+
+long long DateTimeSeconds(const unsigned char* dateTime)
+{
+    unsigned int year = dateTime[5];
+    unsigned int month = dateTime[4] ? dateTime[4] - 1 : 0;
+    if (month > 11)
+        month = 11;
+
+    //Как и в MakeDateTime, високосным считается каждый четвёртый год, начиная с 2000
+    long long days = year * 365LL + (year + 3) / 4;
+    for (unsigned int m = 0; m < month; ++m)
+        days += monthDays[m] + (m == 1 && year % 4 == 0);
+
+    if (dateTime[3])
+        days += dateTime[3] - 1;
+
+    return days * 86400 + dateTime[2] * 3600LL + dateTime[1] * 60LL + dateTime[0];
+}
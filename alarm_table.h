@@ -0,0 +1,127 @@
+#ifndef ALARM_TABLE_H
+#define ALARM_TABLE_H
+
+#include <string.h>
+#include "modbus_device.h"
+#include "register_watch.h"
+
+/*
+    Автомат тревог счётчика, заданный таблицей переходов.
+
+    Вскрытие корпуса выставляет F_TP и записывает время в RG_TP, сильный
+    магнит выставляет F_MG и записывает время в RG_MG, противоток дольше
+    30 с выставляет F_R. Время записывается только при первой установке
+    флага. Магнитная кнопка - штатное воздействие и флагов не ставит.
+
+    Поведение целиком определяется таблицей AlarmTable; AlarmEvaluate
+    применяет её к памяти одного счётчика (Device), а такт Fleet - к
+    массивам состояний и флагов, не собирая память счётчиков.
+*/
+
+//Биты состояния автомата (бит ALARM совпадает с DeviceState::ALARM)
+#define ALARM_STATE_ALARM       (1)     //тревога
+#define ALARM_STATE_REVERSE     (2)     //идёт противоток
+#define ALARM_STATE_COUNT       (4)
+
+#define ALARM_REVERSE_LIMIT_MS  (30000) //длительность противотока до установки F_R
+
+//События автомата (первые четыре совпадают с AffectType)
+enum AlarmEvent
+{
+    EV_CRACK = 0,           //вскрытие корпуса
+    EV_REVERSE_START,       //начало противотока
+    EV_STRONG_MAGNET,       //воздействие сильного магнита
+    EV_MAGNET_BUTTON,       //нажатие магнитной кнопки
+    EV_REVERSE_STOP,        //окончание противотока
+    EV_REVERSE_TIMEOUT,     //противоток длится дольше ALARM_REVERSE_LIMIT_MS (формируется автоматом)
+    EV_COUNT
+};
+
+//Переход автомата
+struct AlarmTransition
+{
+    unsigned char next;         //следующее состояние
+    unsigned short flags;       //биты, устанавливаемые в RG_FL
+    unsigned char stamp;        //смещение регистра, в который записывается время установки флага (0 - нет)
+    char resetReverse;          //обнулить счётчик длительности противотока
+};
+
+extern const AlarmTransition AlarmTable[ALARM_STATE_COUNT][EV_COUNT];
+
+
+/*Время и дата в регистрах RG_TM, RG_TP, RG_MG, RG_PP (6 байт):
+секунды, минуты, часы, день, месяц, год от 2000*/
+#define DATETIME_SIZE (6)
+
+//Перевод секунд от 01.01.2000 00:00:00 в формат регистров времени
+void MakeDateTime(long long seconds, unsigned char* dateTime);
+
+//Обратный перевод: секунды от 01.01.2000 00:00:00 по значению регистра времени
+long long DateTimeSeconds(const unsigned char* dateTime);
+
+
+//Применение перехода к памяти счётчика
+inline void AlarmApply(const AlarmTransition& t, unsigned char* image, const unsigned char* dateTime,
+                       RegisterWatch* watch, unsigned int device)
+{
+    if (!t.flags)
+        return;
+
+    unsigned short flags;
+    memcpy(&flags, image + RG_FL, 2);
+
+    unsigned short added = t.flags & ~flags;
+    if (!added)
+        return;
+
+    if (watch)
+        watch->Touch(device, image, RG_FL, 2);
+
+    flags |= added;
+    memcpy(image + RG_FL, &flags, 2);
+
+    if (t.stamp)
+    {
+        if (watch)
+            watch->Touch(device, image, t.stamp, DATETIME_SIZE);
+        memcpy(image + t.stamp, dateTime, DATETIME_SIZE);
+    }
+}
+
+
+/*Один шаг автомата для одного счётчика: обработка событий events
+(битовая маска AlarmEvent) и продвижение счётчика противотока на elapsedMs.
+Возвращает новое состояние*/
+inline unsigned char AlarmEvaluate(unsigned char state, unsigned char events, unsigned int& reverseMs,
+                                   unsigned int elapsedMs, unsigned char* image, const unsigned char* dateTime,
+                                   RegisterWatch* watch = 0, unsigned int device = 0)
+{
+    while (events)
+    {
+        unsigned int e = __builtin_ctz(events);
+        events &= events - 1;
+
+        const AlarmTransition& t = AlarmTable[state][e];
+        AlarmApply(t, image, dateTime, watch, device);
+        if (t.resetReverse)
+            reverseMs = 0;
+        state = t.next;
+    }
+
+    if (state & ALARM_STATE_REVERSE)
+    {
+        unsigned int before = reverseMs;
+        reverseMs += elapsedMs;
+
+        if (before < ALARM_REVERSE_LIMIT_MS && reverseMs >= ALARM_REVERSE_LIMIT_MS)
+        {
+            const AlarmTransition& t = AlarmTable[state][EV_REVERSE_TIMEOUT];
+            AlarmApply(t, image, dateTime, watch, device);
+            state = t.next;
+        }
+    }
+
+    return state;
+}
+
+#endif // ALARM_TABLE_H
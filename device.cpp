@@ -1,5 +1,17 @@
 #include "device.h"
 #include "Modbus/modbus_general.h"
+#include "register_watch.h"
+#include "alarm_table.h"
+#include <chrono>
+#include <string.h>
+#include <time.h>
+
+//Текущее время в формате регистров времени счётчика
+static void CurrentDateTime(unsigned char* dateTime)
+{
+    //946684800 - секунды от 01.01.1970 до 01.01.2000
+    MakeDateTime((long long)time(NULL) - 946684800LL, dateTime);
+}
 
 Device::Device()
 {
@@ -8,7 +20,16 @@ Device::Device()
 
 void Device::Run()
 {
+    long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    unsigned int elapsed = lastRunMs < 0 ? 0 : (unsigned int)(now - lastRunMs);
+    lastRunMs = now;
 
+    //Продвижение длительности противотока
+    unsigned char dateTime[DATETIME_SIZE];
+    CurrentDateTime(dateTime);
+    alarmState = AlarmEvaluate(alarmState, 0, reverseMs, elapsed, memory.all_memory, dateTime, watch, id);
+    state = (DeviceState)(alarmState & ALARM_STATE_ALARM);
 }
 
 QString Device::SendMessage(QString msg)
@@ -29,3 +50,42 @@ QString Device::SendMessage(QString msg)
     );*/
 
 }
+
+void Device::Affect(AffectType type)
+{
+    unsigned char dateTime[DATETIME_SIZE];
+    CurrentDateTime(dateTime);
+    alarmState = AlarmEvaluate(alarmState, 1U << type, reverseMs, 0, memory.all_memory, dateTime, watch, id);
+    state = (DeviceState)(alarmState & ALARM_STATE_ALARM);
+}
+
+void Device::StopReverse()
+{
+    unsigned char dateTime[DATETIME_SIZE];
+    CurrentDateTime(dateTime);
+    alarmState = AlarmEvaluate(alarmState, 1U << EV_REVERSE_STOP, reverseMs, 0, memory.all_memory, dateTime, watch, id);
+    state = (DeviceState)(alarmState & ALARM_STATE_ALARM);
+}
+
+void Device::Watch(RegisterWatch* watch, unsigned int id)
+{
+    this->watch = watch;
+    this->id = id;
+}
+
+void Device::WriteRegisters(unsigned char offset, const unsigned char* src, unsigned char size)
+{
+    if (offset + size > ALL_MEMORY_SIZE)
+        return;
+
+    if (watch)
+        watch->Touch(id, memory.all_memory, offset, size);
+
+    memcpy(memory.all_memory + offset, src, size);
+}
+
+void Device::LoadMemory(void* context, unsigned int id, unsigned char* image)
+{
+    Device** devices = (Device**)context;
+    memcpy(image, devices[id]->memory.all_memory, ALL_MEMORY_SIZE);
+}
@@ -2,32 +2,14 @@
 #define DEVICE_H
 #include <QString>
 #include "modbus_device.h"
+#include "device_types.h"
+
+class RegisterWatch;
 
 /*
     Этот класс реализует логику счётчика
 */
 
-enum DeviceState
-{
-    NORMAL = 0,
-    ALARM
-};
-
-enum DeviceRegime
-{
-    TECHNOLOGICAL = 0,
-    METROLOGICAL
-};
-
-enum AffectType
-{
-    CRACK = 0,
-    REVERSE_STREAM,
-    STRONG_MAGNET,
-    MAGNET_BUTTON
-};
-
-
 class Device
 {
     //Внутренняя память счётчика
@@ -35,6 +17,15 @@ class Device
 
     //Индикатор состояния
     DeviceState state = NORMAL;
+
+    //Состояние автомата тревог (биты ALARM_STATE_*) и длительность противотока
+    unsigned char alarmState = 0;
+    unsigned int reverseMs = 0;
+    long long lastRunMs = -1;
+
+    //Подписки на изменения регистров (может отсутствовать)
+    RegisterWatch* watch = nullptr;
+    unsigned int id = 0;
 public:
     Device();
     //Device(DeviceConfiguration); //Нужен метод для восстановления предыдущего состоянеия
@@ -52,6 +43,24 @@ public:
     //Эта функция эмулирует внешнее воздействие на счётчик
     void Affect(AffectType);
 
+    //Окончание противотока
+    void StopReverse();
+
+    DeviceState State() const { return state; }
+
+    //Сообщать об изменениях регистров счётчика с номером id в watch
+    void Watch(RegisterWatch* watch, unsigned int id);
+
+    //Запись size байт из src в память счётчика по смещению offset
+    void WriteRegisters(unsigned char offset, const unsigned char* src, unsigned char size);
+
+    //Память счётчика только для чтения
+    const unsigned char* Memory() const { return memory.all_memory; }
+
+    /*Копирование памяти счётчика для RegisterWatch::EndTick,
+    context - массив указателей Device*, индексированный номером счётчика*/
+    static void LoadMemory(void* context, unsigned int id, unsigned char* image);
+
 };
 
 #endif // DEVICE_H
@@ -0,0 +1,28 @@
+#ifndef DEVICE_TYPES_H
+#define DEVICE_TYPES_H
+
+/*
+    Типы, общие для отдельного счётчика (Device) и парка счётчиков (Fleet)
+*/
+
+enum DeviceState
+{
+    NORMAL = 0,
+    ALARM
+};
+
+enum DeviceRegime
+{
+    TECHNOLOGICAL = 0,
+    METROLOGICAL
+};
+
+enum AffectType
+{
+    CRACK = 0,
+    REVERSE_STREAM,
+    STRONG_MAGNET,
+    MAGNET_BUTTON
+};
+
+#endif // DEVICE_TYPES_H
@@ -0,0 +1,363 @@
+#include "fleet.h"
+#include "alarm_table.h"
+#include "fleet_export.h"
+#include "register_watch.h"
+#include "scenario.h"
+#include "Modbus/modbus_slave.h"
+#include <algorithm>
+#include <string.h>
+
+
+//Доступ SlaveProcessT к собранной памяти счётчика парка
+struct FleetMemory
+{
+    unsigned char* image;
+    unsigned long long writable;        //маска записываемых регистров (WritableRegisters)
+    RegisterWatch* watch;
+    unsigned int device;
+    unsigned int offset, size;          //изменённый записью диапазон (size = 0 - память не изменилась)
+
+    unsigned char Read(unsigned char* dest, unsigned int offset, unsigned int size)
+    {
+        memcpy(dest, image + offset, size);
+        return 0;
+    }
+
+    unsigned char Write(unsigned int offset, const unsigned char* src, unsigned int size)
+    {
+        if (!IsWritable(writable, offset, size))
+            return MODBUS_EXCEPTION_ILLEGAL_ADDRESS;
+
+        //Подписчикам нужна память до изменения, а в счётчик возвращается только изменённый диапазон
+        if (memcmp(image + offset, src, size))
+        {
+            if (watch)
+                watch->Touch(device, image, offset, size);
+            memcpy(image + offset, src, size);
+            this->offset = offset;
+            this->size = size;
+        }
+        return 0;
+    }
+};
+
+
+//Пересекается ли диапазон [offset, offset+size) с регистром [reg, reg+regSize)
+static inline bool Overlaps(unsigned int offset, unsigned int size, unsigned int reg, unsigned int regSize)
+{
+    return offset < reg + regSize && reg < offset + size;
+}
+
+
+Fleet::Fleet(unsigned int count):
+    count(count),
+    volume(count, 0),
+    flow(count, 0),
+    seconds(count, 0),
+    flags(count, 0),
+    power(count, 0),
+    cold((size_t)count * ALL_MEMORY_SIZE, 0),
+    buses(count, 0),
+    regimes(count, TECHNOLOGICAL),
+    alarmState(count, 0),
+    reverseStart(count, 0),
+    isChanged(count, 0),
+    clock(0),
+    watch(NULL),
+    exporter(NULL),
+    scenario(NULL)
+{
+}
+
+
+void Fleet::Load(unsigned int device, unsigned char* image) const
+{
+    memcpy(image, Cold(device), ALL_MEMORY_SIZE);
+
+    unsigned int liters = Volume(device);
+    memcpy(image + RG_TV, &liters, 4);
+    memcpy(image + RG_PW, &power[device], 4);
+    MakeDateTime(seconds[device], image + RG_TM);
+    memcpy(image + RG_FL, &flags[device], 2);
+}
+
+
+void Fleet::Store(unsigned int device, const unsigned char* image, unsigned char offset, unsigned char size)
+{
+    if (offset >= ALL_MEMORY_SIZE)
+        return;
+    if (offset + size > ALL_MEMORY_SIZE)
+        size = ALL_MEMORY_SIZE - offset;
+
+    memcpy(Cold(device) + offset, image + offset, size);
+
+    //Часто изменяемые регистры переводятся в своё представление
+    if (Overlaps(offset, size, RG_TV, 4))
+    {
+        unsigned int liters;
+        memcpy(&liters, image + RG_TV, 4);
+        volume[device] = liters * 1000000ULL;
+    }
+
+    if (Overlaps(offset, size, RG_PW, 4))
+        memcpy(&power[device], image + RG_PW, 4);
+
+    if (Overlaps(offset, size, RG_TM, DATETIME_SIZE))
+        seconds[device] = (unsigned int)DateTimeSeconds(image + RG_TM);
+
+    if (Overlaps(offset, size, RG_FL, 2))
+        memcpy(&flags[device], image + RG_FL, 2);
+}
+
+
+unsigned char* Fleet::Process(unsigned int device, unsigned char* frame, unsigned int size, unsigned int& responseSize)
+{
+    unsigned char image[ALL_MEMORY_SIZE];
+    Load(device, image);
+
+    unsigned short address;
+    memcpy(&address, Cold(device) + RG_ADR, 2);
+
+    FleetMemory memory = { image, WritableRegisters((DeviceRegime)regimes[device], flags[device]), watch, device, 0, 0 };
+    unsigned char* response = SlaveProcessT(frame, size, responseSize, (unsigned char)address,
+                                            memory, ALL_MEMORY_SIZE / 2);
+
+    if (memory.size)
+    {
+        Store(device, image, memory.offset, memory.size);
+        if (exporter)
+        {
+            Load(device, image);
+            exporter->Publish(device, image);
+            exporter->EndPublish(clock);
+        }
+    }
+
+    return response;
+}
+
+
+void Fleet::LoadImage(void* context, unsigned int device, unsigned char* image)
+{
+    Fleet* fleet = (Fleet*)context;
+    fleet->Load(device, image);
+}
+
+
+void Fleet::Play(Scenario* scenario)
+{
+    this->scenario = scenario;
+    if (scenario)
+        scenario->Rewind(clock);
+}
+
+
+void Fleet::Post(unsigned int device, unsigned char event, long long time)
+{
+    if (device >= count)
+        return;
+
+    Pending p = { time < 0 ? clock : time, device, event };
+    pending.push_back(p);
+}
+
+
+void Fleet::Affect(unsigned int device, AffectType type, long long time)
+{
+    Post(device, (unsigned char)type, time);
+}
+
+
+void Fleet::StopReverse(unsigned int device, long long time)
+{
+    Post(device, EV_REVERSE_STOP, time);
+}
+
+
+//Переход автомата счётчика device по событию event, произошедшему в момент time
+void Fleet::Evaluate(unsigned int device, unsigned char event, long long time)
+{
+    //Таблица применяется к массивам состояний и флагов; память счётчика
+    //не собирается, отметка времени пишется прямо в редко изменяемый блок
+    const AlarmTransition& t = AlarmTable[alarmState[device]][event];
+
+    //Флаг и его отметка времени записываются только при первой установке
+    unsigned short added = t.flags & ~flags[device];
+    if (added)
+    {
+        if (watch)
+        {
+            unsigned char image[ALL_MEMORY_SIZE];
+            Load(device, image);
+            watch->Touch(device, image, RG_FL, 2);
+            if (t.stamp)
+                watch->Touch(device, image, t.stamp, DATETIME_SIZE);
+        }
+
+        flags[device] |= added;
+        if (t.stamp)
+            MakeDateTime(time / 1000, Cold(device) + t.stamp);
+
+        if (!isChanged[device])
+        {
+            isChanged[device] = 1;
+            changed.push_back(device);
+        }
+    }
+
+    //Начало противотока (переход в него со сбросом длительности) ставит срок
+    if ((t.next & ALARM_STATE_REVERSE) && t.resetReverse)
+    {
+        reverseStart[device] = time;
+        reverseDeadlines.push(Deadline(time + ALARM_REVERSE_LIMIT_MS, device));
+    }
+
+    alarmState[device] = t.next;
+}
+
+
+void Fleet::SetFlow(unsigned int device, unsigned int mlPerSecond, long long time)
+{
+    //Объём уже наращён до clock по прежнему расходу: поправка за время после time
+    if (time >= 0 && time < clock)
+    {
+        long long delta = ((long long)mlPerSecond - flow[device]) * (clock - time);
+        if (watch && delta)
+        {
+            unsigned char image[ALL_MEMORY_SIZE];
+            Load(device, image);
+            watch->Touch(device, image, RG_TV, 4);
+        }
+
+        if (delta < 0 && (unsigned long long)-delta > volume[device])
+            volume[device] = 0;
+        else
+            volume[device] += delta;
+    }
+
+    flow[device] = mlPerSecond;
+}
+
+
+void Fleet::SetClock(long long ms)
+{
+    clock = ms;
+
+    unsigned int now = (unsigned int)(ms / 1000);
+    for (unsigned int d = 0; d < count; ++d)
+        seconds[d] = now;
+}
+
+
+void Fleet::Tick(unsigned int elapsedMs)
+{
+    long long before = clock;
+    clock += elapsedMs;
+
+    unsigned int step = (unsigned int)(clock / 1000 - before / 1000);
+
+    //Подписчикам на показания и часы нужна память до изменения;
+    //без подписок такт не собирает память счётчиков
+    if (watch)
+    {
+        bool isVolumeWatched = watch->IsWatched(RG_TV, 4);
+        bool isTimeWatched = step && watch->IsWatched(RG_TM, DATETIME_SIZE);
+
+        if (isVolumeWatched || isTimeWatched)
+        {
+            unsigned char image[ALL_MEMORY_SIZE];
+            for (unsigned int d = 0; d < count; ++d)
+            {
+                bool isVolumeChanged = isVolumeWatched && flow[d];
+                if (!isVolumeChanged && !isTimeWatched)
+                    continue;
+
+                Load(d, image);
+                if (isVolumeChanged)
+                    watch->Touch(d, image, RG_TV, 4);
+                if (isTimeWatched)
+                    watch->Touch(d, image, RG_TM, DATETIME_SIZE);
+            }
+        }
+    }
+
+    //Проход по всему парку касается только массивов часто изменяемых регистров
+    unsigned long long* v = volume.data();
+    const unsigned int* f = flow.data();
+    for (unsigned int d = 0; d < count; ++d)
+        v[d] += (unsigned long long)f[d] * elapsedMs;
+
+    if (step)
+    {
+        unsigned int* s = seconds.data();
+        for (unsigned int d = 0; d < count; ++d)
+            s[d] += step;
+    }
+
+    //События сценария, наступившие за такт, применяются пачкой со своими моментами
+    if (scenario)
+        scenario->Apply(*this, clock);
+
+    //События такта обрабатываются в порядке модельного времени
+    std::stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b)
+    {
+        return a.time < b.time;
+    });
+
+    for (unsigned int i = 0; i < pending.size(); ++i)
+    {
+        const Pending& p = pending[i];
+        unsigned int d = p.device;
+
+        //Противоток, который к моменту события длился уже 30 с, сначала ставит F_R:
+        //иначе окончание в том же такте, что и срок, перевело бы счётчик в норму без тревоги
+        long long deadline = reverseStart[d] + ALARM_REVERSE_LIMIT_MS;
+        if ((alarmState[d] & ALARM_STATE_REVERSE) && deadline <= p.time && !(flags[d] & 1U << F_R))
+            Evaluate(d, EV_REVERSE_TIMEOUT, deadline);
+
+        Evaluate(d, p.event, p.time);
+    }
+    pending.clear();
+
+    //Истёкшие сроки противотока превращаются в событие EV_REVERSE_TIMEOUT;
+    //сроки прерванных или перезапущенных противотоков пропускаются
+    while (!reverseDeadlines.empty() && reverseDeadlines.top().first <= clock)
+    {
+        Deadline deadline = reverseDeadlines.top();
+        reverseDeadlines.pop();
+
+        unsigned int d = deadline.second;
+        if ((alarmState[d] & ALARM_STATE_REVERSE) && reverseStart[d] + ALARM_REVERSE_LIMIT_MS == deadline.first
+                && !(flags[d] & 1U << F_R))
+            Evaluate(d, EV_REVERSE_TIMEOUT, deadline.first);
+    }
+
+    //При смене секунды весь парк выгружается ниже
+    if (exporter && !step)
+    {
+        unsigned char image[ALL_MEMORY_SIZE];
+        for (unsigned int i = 0; i < changed.size(); ++i)
+        {
+            Load(changed[i], image);
+            exporter->Publish(changed[i], image);
+        }
+    }
+
+    if (exporter)
+    {
+        if (step)
+        {
+            unsigned char image[ALL_MEMORY_SIZE];
+            for (unsigned int d = 0; d < count; ++d)
+            {
+                Load(d, image);
+                exporter->Publish(d, image);
+            }
+        }
+        if (step || !changed.empty())
+            exporter->EndPublish(clock);
+    }
+    for (unsigned int i = 0; i < changed.size(); ++i)
+        isChanged[changed[i]] = 0;
+    changed.clear();
+}
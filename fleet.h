@@ -0,0 +1,193 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <functional>
+#include <new>
+#include <queue>
+#include <stdlib.h>
+#include <vector>
+#include "device_types.h"
+#include "modbus_device.h"
+
+class RegisterWatch;
+class FleetExport;
+class Scenario;
+
+/*
+    Парк счётчиков для моделирования в больших масштабах.
+
+    Память счётчиков разделена на часто и редко изменяемую части
+    (структура массивов). Регистры, которые меняются каждый такт или
+    при каждом воздействии, хранятся отдельными непрерывными массивами,
+    выровненными на строку кэша:
+    - RG_TV - объём в микролитрах (в регистре - целые литры),
+      расход - в мл/с (= мкл/мс), объём нарастает каждый такт;
+    - RG_TM - секунды от 01.01.2000 (в регистре - формат времени);
+    - RG_FL, RG_PW - значения регистров как есть.
+    Паспортные данные и калибровка (RG_SN, RG_VP, RG_CS, RG_PP, RG_K1,
+    RG_K2, RG_ADR), отметки времени тревог и индексы архивов лежат
+    в отдельном блоке по ALL_MEMORY_SIZE байт на счётчик со смещениями
+    RG_*; места часто изменяемых регистров в нём не используются.
+    Такт проходит только по массивам часто изменяемых регистров,
+    их циклы векторизуются компилятором.
+
+    Для протокола Modbus и RegisterWatch счётчик по-прежнему выглядит
+    памятью из ALL_MEMORY_SIZE байт: Load собирает её из обеих частей,
+    Store раскладывает записанный диапазон обратно, Process обрабатывает
+    кадр через SlaveProcessT с правами записи режима счётчика
+    (WritableRegisters).
+
+    Состояние автомата тревог тоже хранится массивами. Воздействия
+    копятся за такт вместе с модельным моментом, когда они произошли,
+    а такт (Tick) применяет к ним таблицу AlarmTable в порядке времени.
+    Окончание 30-секундного противотока отслеживается очередью сроков,
+    а не обходом счётчиков с противотоком, поэтому стоимость обработки
+    тревог пропорциональна числу воздействий. Срок сравнивается с
+    моментами событий, а не с границами тактов, так что результат не
+    зависит от длительности такта: противоток, закончившийся через 45 с,
+    ставит F_R, даже если начало, срок и окончание попали в один такт.
+*/
+
+#define FLEET_CACHE_LINE    (64)
+
+//Распределитель памяти, выравнивающий массивы на строку кэша
+template<typename T>
+struct CacheLineAllocator
+{
+    typedef T value_type;
+
+    CacheLineAllocator() {}
+    template<typename U> CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        size_t size = (n * sizeof(T) + FLEET_CACHE_LINE - 1) / FLEET_CACHE_LINE * FLEET_CACHE_LINE;
+        void* memory = aligned_alloc(FLEET_CACHE_LINE, size ? size : FLEET_CACHE_LINE);
+        if (!memory)
+            throw std::bad_alloc();
+        return (T*)memory;
+    }
+
+    void deallocate(T* p, size_t) { free(p); }
+
+    template<typename U> bool operator==(const CacheLineAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const CacheLineAllocator<U>&) const { return false; }
+};
+
+
+class Fleet
+{
+    template<typename T> using AlignedArray = std::vector<T, CacheLineAllocator<T>>;
+
+    unsigned int count;
+
+    //Часто изменяемые регистры
+    AlignedArray<unsigned long long> volume;        //RG_TV: объём, мкл
+    AlignedArray<unsigned int> flow;                //расход, мл/с
+    AlignedArray<unsigned int> seconds;             //RG_TM: секунды от 01.01.2000
+    AlignedArray<unsigned short> flags;             //RG_FL
+    AlignedArray<unsigned int> power;               //RG_PW
+
+    //Редко изменяемые регистры: count * ALL_MEMORY_SIZE байт
+    AlignedArray<unsigned char> cold;
+
+    std::vector<unsigned int> buses;            //номер шины, к которой подключён счётчик
+    std::vector<unsigned char> regimes;         //режим счётчика (DeviceRegime)
+
+    //Состояние автомата тревог
+    std::vector<unsigned char> alarmState;      //биты ALARM_STATE_*
+    std::vector<long long> reverseStart;        //момент начала текущего противотока
+
+    //Событие автомата, ожидающее такта
+    struct Pending
+    {
+        long long time;                         //модельный момент события
+        unsigned int device;
+        unsigned char event;                    //AlarmEvent
+    };
+    std::vector<Pending> pending;               //события текущего такта в порядке поступления
+    std::vector<unsigned int> changed;          //счётчики, изменённые автоматом в такте (без повторов)
+    std::vector<unsigned char> isChanged;       //счётчик уже есть в changed
+
+    //Сроки окончания 30 с противотока: (момент, счётчик), ближайший - сверху
+    typedef std::pair<long long, unsigned int> Deadline;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> reverseDeadlines;
+
+    long long clock;                            //модельное время, мс от 01.01.2000
+    RegisterWatch* watch;
+    FleetExport* exporter;
+    Scenario* scenario;
+
+    void Post(unsigned int device, unsigned char event, long long time);
+    void Evaluate(unsigned int device, unsigned char event, long long time);
+public:
+    explicit Fleet(unsigned int count);
+
+    unsigned int Count() const { return count; }
+
+    //Память счётчика device в виде ALL_MEMORY_SIZE байт (сборка из обеих частей)
+    void Load(unsigned int device, unsigned char* image) const;
+
+    //Записать диапазон [offset, offset+size) памяти image в счётчик device
+    void Store(unsigned int device, const unsigned char* image, unsigned char offset, unsigned char size);
+
+    /*Обработка кадра Modbus счётчиком device через SlaveProcessT; запись в защищённые
+    регистры вне метрологического режима отклоняется исключением 0x02
+    (возвращает кадр-ответ, выделенный malloc, или NULL, если ответа нет)*/
+    unsigned char* Process(unsigned int device, unsigned char* frame, unsigned int size, unsigned int& responseSize);
+
+    //Редко изменяемая часть памяти счётчика (паспортные данные, калибровка) со смещениями RG_*
+    unsigned char* Cold(unsigned int device) { return &cold[(size_t)device * ALL_MEMORY_SIZE]; }
+    const unsigned char* Cold(unsigned int device) const { return &cold[(size_t)device * ALL_MEMORY_SIZE]; }
+
+    //Часто изменяемые регистры
+    unsigned int Volume(unsigned int device) const { return (unsigned int)(volume[device] / 1000000); }
+    unsigned int Flow(unsigned int device) const { return flow[device]; }
+    //Расход с модельного момента time (по умолчанию - с текущего модельного времени)
+    void SetFlow(unsigned int device, unsigned int mlPerSecond, long long time = -1);
+    unsigned short Flags(unsigned int device) const { return flags[device]; }
+    unsigned int Power(unsigned int device) const { return power[device]; }
+    void SetPower(unsigned int device, unsigned int value) { power[device] = value; }
+
+    //Шина, к которой подключён счётчик
+    unsigned int Bus(unsigned int device) const { return buses[device]; }
+    void SetBus(unsigned int device, unsigned int bus) { buses[device] = bus; }
+
+    //Режим счётчика (по умолчанию TECHNOLOGICAL)
+    DeviceRegime Regime(unsigned int device) const { return (DeviceRegime)regimes[device]; }
+    void SetRegime(unsigned int device, DeviceRegime regime) { regimes[device] = regime; }
+
+    //Сообщать об изменениях регистров в watch (размер watch - не меньше Count)
+    void Watch(RegisterWatch* watch) { this->watch = watch; }
+
+    /*Выгружать образы памяти счётчиков в exporter (размер exporter - не меньше Count):
+    весь парк - на тактах, где сменилась модельная секунда, счётчики с воздействиями
+    и записью по Modbus - сразу*/
+    void Export(FleetExport* exporter) { this->exporter = exporter; }
+
+    /*Воспроизводить scenario с текущего модельного времени: каждый такт применяет
+    события сценария, срок которых наступил (NULL - прекратить)*/
+    void Play(Scenario* scenario);
+
+    //Копирование памяти счётчика для RegisterWatch::EndTick (context - указатель на Fleet)
+    static void LoadImage(void* context, unsigned int device, unsigned char* image);
+
+    /*Внешнее воздействие на счётчик в модельный момент time (мс от 01.01.2000,
+    по умолчанию - текущее модельное время), обрабатывается на ближайшем такте*/
+    void Affect(unsigned int device, AffectType type, long long time = -1);
+
+    //Окончание противотока в момент time
+    void StopReverse(unsigned int device, long long time = -1);
+
+    DeviceState State(unsigned int device) const { return (DeviceState)(alarmState[device] & 1); }
+
+    //Модельное время, мс от 01.01.2000 (SetClock выставляет и часы всех счётчиков)
+    long long Clock() const { return clock; }
+    void SetClock(long long ms);
+
+    /*Такт длительностью elapsedMs: продвижение часов и объёма всех счётчиков,
+    применение событий сценария, обработка накопленных воздействий*/
+    void Tick(unsigned int elapsedMs);
+};
+
+#endif // FLEET_H
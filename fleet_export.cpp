@@ -0,0 +1,117 @@
+#include "fleet_export.h"
+#include "modbus_device.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(FLEET_SHM_IMAGE_SIZE == ALL_MEMORY_SIZE, "Exported image must match device memory");
+
+
+FleetExport::FleetExport():
+    fd(-1),
+    header(NULL),
+    slots(NULL),
+    count(0)
+{
+    name[0] = 0;
+}
+
+
+FleetExport::~FleetExport()
+{
+    Close();
+}
+
+
+bool FleetExport::Open(const char* name, unsigned int count)
+{
+    Close();
+
+    if (snprintf(this->name, sizeof(this->name), "%s", name) >= (int)sizeof(this->name))
+        return false;
+
+    //Старый сегмент удаляется: читатели, которые его ещё держат, не увидят частично размеченный новый
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t size = FLEET_SHM_SIZE(count);
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (memory == MAP_FAILED)
+    {
+        close(fd);
+        fd = -1;
+        shm_unlink(name);
+        return false;
+    }
+
+    this->count = count;
+    header = (FleetShmHeader*)memory;
+    slots = (FleetShmSlot*)((unsigned char*)memory + FLEET_SHM_SLOT_SIZE);
+
+    //Память сегмента уже обнулена ftruncate; magic записывается последним
+    header->version = FLEET_SHM_VERSION;
+    header->count = count;
+    header->slotSize = FLEET_SHM_SLOT_SIZE;
+    header->imageSize = FLEET_SHM_IMAGE_SIZE;
+    header->imageOffset = offsetof(FleetShmSlot, image);
+    __atomic_store_n(&header->magic, FLEET_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+void FleetExport::Close()
+{
+    if (header)
+    {
+        munmap(header, FLEET_SHM_SIZE(count));
+        header = NULL;
+        slots = NULL;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+        shm_unlink(name);
+    }
+    count = 0;
+}
+
+
+void FleetExport::Publish(unsigned int device, const unsigned char* image)
+{
+    if (device >= count)
+        return;
+
+    FleetShmSlot& slot = slots[device];
+    if (!memcmp(slot.image, image, FLEET_SHM_IMAGE_SIZE))
+        return;
+
+    //Нечётная последовательность предупреждает читателей о записи;
+    //барьер не даёт записи образа опередить её
+    unsigned int sequence = slot.sequence;
+    __atomic_store_n(&slot.sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(slot.image, image, FLEET_SHM_IMAGE_SIZE);
+
+    __atomic_store_n(&slot.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+void FleetExport::EndPublish(long long clock)
+{
+    if (!header)
+        return;
+
+    __atomic_store_n(&header->clock, clock, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->publishes, header->publishes + 1, __ATOMIC_RELEASE);
+}
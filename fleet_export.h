@@ -0,0 +1,46 @@
+#ifndef FLEET_EXPORT_H
+#define FLEET_EXPORT_H
+
+#include "fleet_shm.h"
+
+/*
+    Выгрузка образов памяти счётчиков в разделяемую память POSIX
+    для внешних процессов (архиватор, панели наблюдения), которым
+    иначе пришлось бы опрашивать счётчики по Modbus.
+
+    Разметка сегмента и протокол чтения описаны в fleet_shm.h,
+    библиотека для читателей на C - tools/shmreader.
+
+    Publish вызывается только из потока моделирования. Неизменившийся
+    образ не переписывается, чтобы не заставлять читателей повторять
+    чтение.
+*/
+
+class FleetExport
+{
+    char name[64];
+    int fd;
+    FleetShmHeader* header;
+    FleetShmSlot* slots;
+    unsigned int count;
+public:
+    FleetExport();
+    ~FleetExport();
+
+    /*Создать сегмент name (например, "/metrolator") для count счётчиков;
+    существующий сегмент с тем же именем заменяется*/
+    bool Open(const char* name, unsigned int count);
+
+    //Отключиться от сегмента и удалить его
+    void Close();
+
+    unsigned int Count() const { return count; }
+
+    //Выгрузить образ памяти счётчика device (FLEET_SHM_IMAGE_SIZE байт)
+    void Publish(unsigned int device, const unsigned char* image);
+
+    //Отметить окончание выгрузки на модельный момент clock (мс от 01.01.2000)
+    void EndPublish(long long clock);
+};
+
+#endif // FLEET_EXPORT_H
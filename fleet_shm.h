@@ -0,0 +1,66 @@
+#ifndef FLEET_SHM_H
+#define FLEET_SHM_H
+
+/*
+    Разметка сегмента разделяемой памяти POSIX с образами памяти
+    счётчиков парка (общая для моделирования и внешних читателей,
+    заголовок пригоден для C).
+
+    Сегмент создаётся shm_open с именем вида "/metrolator" и состоит из
+    заголовка FleetShmHeader (FLEET_SHM_SLOT_SIZE байт) и следом count
+    ячеек FleetShmSlot, по одной на счётчик, в порядке номеров счётчиков.
+    Ячейка занимает две строки кэша и выровнена на строку кэша, поэтому
+    запись одного счётчика не мешает чтению соседних.
+
+    Образ - ALL_MEMORY_SIZE байт памяти счётчика со смещениями RG_*,
+    как его видит протокол Modbus. Все числа - в порядке байтов
+    машины, на которой идёт моделирование.
+
+    Каждая ячейка защищена счётчиком последовательности (seqlock).
+    Писатель (только поток моделирования) делает sequence нечётным,
+    меняет образ и делает sequence следующим чётным числом. Читатель
+    копирует нужные байты между двумя чтениями sequence и принимает
+    копию, если оба значения совпали и чётны; иначе повторяет чтение.
+    Читатели не делают системных вызовов и не задерживают писателя.
+
+    Заголовок заполняется до записи magic, поэтому читатель, увидевший
+    FLEET_SHM_MAGIC, может полагаться на остальные поля.
+*/
+
+#define FLEET_SHM_MAGIC         (0x4D48534DU)   //"MSHM"
+#define FLEET_SHM_VERSION       (1)
+#define FLEET_SHM_IMAGE_SIZE    (112)           //= ALL_MEMORY_SIZE
+#define FLEET_SHM_SLOT_SIZE     (128)           //размер заголовка и ячейки
+
+//Заголовок сегмента
+struct FleetShmHeader
+{
+    unsigned int magic;             //FLEET_SHM_MAGIC
+    unsigned int version;           //FLEET_SHM_VERSION
+    unsigned int count;             //количество ячеек (счётчиков)
+    unsigned int slotSize;          //FLEET_SHM_SLOT_SIZE
+    unsigned int imageSize;         //FLEET_SHM_IMAGE_SIZE
+    unsigned int imageOffset;       //смещение образа в ячейке
+    long long clock;                //модельное время последней выгрузки, мс от 01.01.2000
+    unsigned long long publishes;   //количество выгрузок (растёт с каждой)
+    unsigned char reserved[FLEET_SHM_SLOT_SIZE - 40];
+};
+
+//Ячейка счётчика
+struct FleetShmSlot
+{
+    unsigned int sequence;          //чётное - образ согласован, нечётное - идёт запись
+    unsigned int reserved;
+    unsigned char image[FLEET_SHM_IMAGE_SIZE];
+    unsigned char reserved2[FLEET_SHM_SLOT_SIZE - 8 - FLEET_SHM_IMAGE_SIZE];
+};
+
+#ifdef __cplusplus
+static_assert(sizeof(FleetShmHeader) == FLEET_SHM_SLOT_SIZE, "FleetShmHeader must be one slot");
+static_assert(sizeof(FleetShmSlot) == FLEET_SHM_SLOT_SIZE, "FleetShmSlot size is part of the layout");
+#endif
+
+//Размер сегмента для count счётчиков
+#define FLEET_SHM_SIZE(count)   ((unsigned long long)((count) + 1) * FLEET_SHM_SLOT_SIZE)
+
+#endif // FLEET_SHM_H
@@ -8,6 +8,12 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+#Асинхронный Modbus-клиент использует сопрограммы C++20
+CONFIG += c++2a
+
+#Выгрузка образов счётчиков в разделяемую память (shm_open)
+LIBS += -lrt
+
 TARGET = metrolator
 TEMPLATE = app
 
@@ -29,14 +35,38 @@ SOURCES += \
     device.cpp \
     Modbus/modbus_general.cpp \
     modbus_device.cpp \
-    device_view.cpp
+    device_view.cpp \
+    register_watch.cpp \
+    Modbus/modbus_client.cpp \
+    Modbus/modbus_line.cpp \
+    Modbus/modbus_faults.cpp \
+    Modbus/modbus_gateway.cpp \
+    alarm_table.cpp \
+    fleet.cpp \
+    fleet_export.cpp \
+    provisioning.cpp \
+    scenario.cpp
 
 HEADERS += \
         mainwindow.h \
     device.h \
     Modbus/modbus_general.h \
+    Modbus/modbus_slave.h \
     modbus_device.h \
-    device_view.h
+    device_view.h \
+    register_watch.h \
+    Modbus/modbus_client.h \
+    Modbus/modbus_line.h \
+    Modbus/modbus_faults.h \
+    Modbus/modbus_gateway.h \
+    Modbus/counter_rng.h \
+    device_types.h \
+    alarm_table.h \
+    fleet.h \
+    fleet_export.h \
+    fleet_shm.h \
+    provisioning.h \
+    scenario.h
 
 FORMS += \
         mainwindow.ui
@@ -3,6 +3,9 @@
 
 //Библиотека функций протокола Modbus, зависимых от устройства
 
+#include <string.h>
+#include "device_types.h"
+
 #define ALL_MEMORY_SIZE (112)                   //Память Modbus устройства в байтах
 
 //Таблица памяти Modbus
@@ -35,23 +38,23 @@ void MBS_write_registers(int offset, unsigned char* src, unsigned char reg_cnt);
 
 //Имя регистра      //Смещение      //Содержимое регистра
 
-#define RG_SN =     (0x0);          //Серийный номер
-#define RG_VP =     (0x4);          //Версия ПО счётчика
-#define RG_CS =     (0x6);          //Контрольная сумма метрологического модуля ПО
-#define RG_PP =     (0x8);          //Время и дата первичной проверки
-#define RG_K1 =     (0xE);          //Калибровочный коэффициент k1
-#define RG_K2 =     (0x12);         //Калибровочный коэффициент k2
-#define RG_ADR =    (0x16);         //Сетевой адрес Modbus
-#define RG_TV =     (0x30);         //Текущие показания счётчика
-#define RG_PW =     (0x34);         //Напряжение батареи
-#define RG_SA =     (0x38);         //Индекс суточного архива
-#define RG_MA =     (0x3A);         //Индекс месячного архива
-#define RG_TM =     (0x3C);         //Текущее время и дата
-#define RG_FL =     (0x42);         //Флаги
-#define RG_TP =     (0x50);         //Время и дата вскрытия
-#define RG_MG =     (0x56);         //Время и дата воздействия сильного магнита
-#define RG_HC =     (0x5C);         //Индекс журнала нештатных событий
-#define RG_CC =     (0x5E);         //Индекс журнала системных событий
+#define RG_SN       (0x0)           //Серийный номер
+#define RG_VP       (0x4)           //Версия ПО счётчика
+#define RG_CS       (0x6)           //Контрольная сумма метрологического модуля ПО
+#define RG_PP       (0x8)           //Время и дата первичной проверки
+#define RG_K1       (0xE)           //Калибровочный коэффициент k1
+#define RG_K2       (0x12)          //Калибровочный коэффициент k2
+#define RG_ADR      (0x16)          //Сетевой адрес Modbus
+#define RG_TV       (0x30)          //Текущие показания счётчика
+#define RG_PW       (0x34)          //Напряжение батареи
+#define RG_SA       (0x38)          //Индекс суточного архива
+#define RG_MA       (0x3A)          //Индекс месячного архива
+#define RG_TM       (0x3C)          //Текущее время и дата
+#define RG_FL       (0x42)          //Флаги
+#define RG_TP       (0x50)          //Время и дата вскрытия
+#define RG_MG       (0x56)          //Время и дата воздействия сильного магнита
+#define RG_HC       (0x5C)          //Индекс журнала нештатных событий
+#define RG_CC       (0x5E)          //Индекс журнала системных событий
 
 //Номера битов флагов флагового регистра относительно начала регистра
 
@@ -63,4 +66,47 @@ void MBS_write_registers(int offset, unsigned char* src, unsigned char reg_cnt);
 #define F_CL        (1)             //Очистка памяти счётчика
 #define F_BL        (0)             //Перевод в метрологический режим
 
+
+/*Права записи регистров по протоколу Modbus.
+Память - ALL_MEMORY_SIZE/2 двухбайтовых регистров, права умещаются в одно
+64-битное слово: бит i - регистр по смещению 2*i. Паспортные данные и
+калибровка (RG_SN, RG_VP, RG_CS, RG_K1, RG_K2) записываются только
+в метрологическом режиме, пока не установлен флаг F_BL.*/
+
+static_assert(ALL_MEMORY_SIZE / 2 <= 64, "Register write mask must fit in 64 bits");
+
+//Биты регистров, которых касается диапазон [offset, offset+size) байт (offset+size <= 128)
+constexpr unsigned long long RegisterMask(unsigned int offset, unsigned int size)
+{
+    return size == 0 ? 0 :
+           ((offset + size + 1) / 2 - offset / 2 >= 64 ? ~0ULL : (1ULL << ((offset + size + 1) / 2 - offset / 2)) - 1) << offset / 2;
+}
+
+#define REGISTERS_ALL       (RegisterMask(0, ALL_MEMORY_SIZE))
+#define REGISTERS_PROTECTED (RegisterMask(RG_SN, 4) | RegisterMask(RG_VP, 2) | RegisterMask(RG_CS, 2) | \
+                             RegisterMask(RG_K1, 4) | RegisterMask(RG_K2, 4))
+
+//Маска записываемых регистров для режима regime и значения регистра флагов flags
+inline unsigned long long WritableRegisters(DeviceRegime regime, unsigned short flags)
+{
+    //[0] - защищённые регистры закрыты, [1] - открыты
+    static const unsigned long long masks[2] = { REGISTERS_ALL & ~REGISTERS_PROTECTED, REGISTERS_ALL };
+    return masks[regime == METROLOGICAL && !(flags >> F_BL & 1)];
+}
+
+//Можно ли записать диапазон [offset, offset+size) байт при маске writable
+inline bool IsWritable(unsigned long long writable, unsigned int offset, unsigned int size)
+{
+    return !(RegisterMask(offset, size) & ~writable);
+}
+
+/*Права записи памяти счётчика для ModbusLine::AddSlave: context указывает на режим
+счётчика (DeviceRegime), флаги берутся из регистра RG_FL самой памяти*/
+inline bool IsDeviceWritable(const unsigned char* memory, unsigned int offset, unsigned int size, void* context)
+{
+    unsigned short flags;
+    memcpy(&flags, memory + RG_FL, 2);
+    return IsWritable(WritableRegisters(*(const DeviceRegime*)context, flags), offset, size);
+}
+
 #endif // MODBUS_DEVICE_H
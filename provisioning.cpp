@@ -0,0 +1,456 @@
+#include "provisioning.h"
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+//Минимальный объём данных на поток: на маленьких манифестах потоки не окупаются
+#define PROVISION_MIN_CHUNK (1U << 16)
+
+
+//Ошибки, найденные одним потоком
+struct ProvisionErrors
+{
+    unsigned int count;
+    unsigned int first;
+};
+
+
+//Запись паспортных данных в память счётчика
+static void StoreIdentity(unsigned char* image, unsigned int sn, unsigned short vp, const unsigned char* pp,
+                          float k1, float k2, unsigned short adr)
+{
+    memcpy(image + RG_SN, &sn, 4);
+    memcpy(image + RG_VP, &vp, 2);
+    memcpy(image + RG_PP, pp, 6);
+    memcpy(image + RG_K1, &k1, 4);
+    memcpy(image + RG_K2, &k2, 4);
+    memcpy(image + RG_ADR, &adr, 2);
+}
+
+
+static void Fail(ProvisionErrors& errors, unsigned int record)
+{
+    if (!errors.count++)
+        errors.first = record;
+}
+
+
+
+
+//Далее следует разбор CSV
+
+
+//Пропуск пробелов и разделителя поля
+static bool SkipSeparator(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    if (p >= end || (*p != ',' && *p != ';'))
+        return false;
+    ++p;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    return true;
+}
+
+
+template<typename T>
+static bool ParseNumber(const char*& p, const char* end, T& value)
+{
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+        return false;
+
+    p = result.ptr;
+    return true;
+}
+
+
+//Число из ровно count цифр
+static bool ParseDigits(const char*& p, const char* end, unsigned int count, unsigned int& value)
+{
+    if (end - p < (long)count)
+        return false;
+
+    value = 0;
+    for (unsigned int i = 0; i < count; ++i, ++p)
+    {
+        if (*p < '0' || *p > '9')
+            return false;
+        value = value * 10 + (*p - '0');
+    }
+
+    return true;
+}
+
+
+//Дата "ГГГГ-ММ-ДД" или "ГГГГ-ММ-ДД чч:мм:сс" в формате регистров времени
+static bool ParseDate(const char*& p, const char* end, unsigned char* dateTime)
+{
+    unsigned int year, month, day, hour = 0, minute = 0, second = 0;
+
+    if (!ParseDigits(p, end, 4, year) || p >= end || *p++ != '-'
+            || !ParseDigits(p, end, 2, month) || p >= end || *p++ != '-'
+            || !ParseDigits(p, end, 2, day))
+        return false;
+
+    if (p < end && (*p == ' ' || *p == 'T') && end - p > 1 && p[1] >= '0' && p[1] <= '9')
+    {
+        ++p;
+        if (!ParseDigits(p, end, 2, hour) || p >= end || *p++ != ':'
+                || !ParseDigits(p, end, 2, minute) || p >= end || *p++ != ':'
+                || !ParseDigits(p, end, 2, second))
+            return false;
+    }
+
+    if (year < 2000 || year > 2255 || !month || month > 12 || !day || day > 31
+            || hour > 23 || minute > 59 || second > 59)
+        return false;
+
+    dateTime[0] = second;
+    dateTime[1] = minute;
+    dateTime[2] = hour;
+    dateTime[3] = day;
+    dateTime[4] = month;
+    dateTime[5] = year - 2000;
+
+    return true;
+}
+
+
+//Разбор строки манифеста [p, end) в память счётчика
+static bool ParseLine(const char* p, const char* end, unsigned char* image, unsigned int& bus)
+{
+    unsigned int sn;
+    unsigned int adr;
+    float k1, k2;
+    unsigned short vp;
+    unsigned char pp[6];
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    if (!ParseNumber(p, end, bus) || !SkipSeparator(p, end)
+            || !ParseNumber(p, end, sn) || !SkipSeparator(p, end)
+            || !ParseNumber(p, end, adr) || !SkipSeparator(p, end)
+            || !ParseNumber(p, end, k1) || !SkipSeparator(p, end)
+            || !ParseNumber(p, end, k2) || !SkipSeparator(p, end)
+            || !ParseNumber(p, end, vp) || !SkipSeparator(p, end)
+            || !ParseDate(p, end, pp))
+        return false;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    if (p != end || bus > PROVISION_MAX_BUS || !adr || adr > 247)
+        return false;
+
+    StoreIdentity(image, sn, vp, pp, k1, k2, adr);
+    return true;
+}
+
+
+/*Обход непустых строк куска [begin, end): кусок начинается с начала строки,
+строка, начатая в куске, принадлежит ему целиком (может заканчиваться за end)*/
+template<typename F>
+static void ForEachLine(const char* begin, const char* end, const char* fileEnd, F f)
+{
+    const char* p = begin;
+    while (p < end)
+    {
+        const char* newline = (const char*)memchr(p, '\n', fileEnd - p);
+        const char* lineEnd = newline ? newline : fileEnd;
+        const char* next = newline ? newline + 1 : fileEnd;
+
+        if (lineEnd > p && lineEnd[-1] == '\r')
+            --lineEnd;
+
+        if (lineEnd > p)
+            f(p, lineEnd);
+
+        p = next;
+    }
+}
+
+
+static Fleet* ProvisionCsv(const char* data, size_t size, unsigned int threads, ProvisionReport& report)
+{
+    const char* end = data + size;
+    const char* begin = data;
+
+    //Заголовок
+    if (begin < end && (*begin < '0' || *begin > '9') && *begin != ' ' && *begin != '\t')
+    {
+        const char* newline = (const char*)memchr(begin, '\n', size);
+        begin = newline ? newline + 1 : end;
+    }
+
+    size_t length = end - begin;
+    if (threads > length / PROVISION_MIN_CHUNK)
+        threads = length / PROVISION_MIN_CHUNK;
+    if (!threads)
+        threads = 1;
+
+    //Границы кусков сдвигаются на начало следующей строки
+    std::vector<const char*> bounds(threads + 1);
+    bounds[0] = begin;
+    bounds[threads] = end;
+    for (unsigned int t = 1; t < threads; ++t)
+    {
+        const char* p = begin + length / threads * t;
+        if (p < bounds[t - 1])
+            p = bounds[t - 1];
+
+        const char* newline = (const char*)memchr(p, '\n', end - p);
+        bounds[t] = newline ? newline + 1 : end;
+    }
+
+    //Первый проход: количество строк в каждом куске
+    std::vector<unsigned int> first(threads + 1, 0);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                unsigned int lines = 0;
+                ForEachLine(bounds[t], bounds[t + 1], end, [&](const char*, const char*) { ++lines; });
+                first[t + 1] = lines;
+            });
+        }
+        for (unsigned int t = 0; t < threads; ++t)
+            workers[t].join();
+    }
+
+    for (unsigned int t = 0; t < threads; ++t)
+        first[t + 1] += first[t];
+
+    Fleet* fleet = new Fleet(first[threads]);
+
+    //Второй проход: разбор строк сразу в память своих счётчиков
+    std::vector<ProvisionErrors> errors(threads);
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                ProvisionErrors& e = errors[t];
+                e.count = 0;
+                e.first = 0;
+
+                unsigned int device = first[t];
+                ForEachLine(bounds[t], bounds[t + 1], end, [&](const char* line, const char* lineEnd)
+                {
+                    unsigned int bus;
+                    //Память ошибочной записи остаётся нулевой
+                    if (ParseLine(line, lineEnd, fleet->Cold(device), bus))
+                        fleet->SetBus(device, bus);
+                    else
+                        Fail(e, device);
+                    ++device;
+                });
+            });
+        }
+        for (unsigned int t = 0; t < threads; ++t)
+            workers[t].join();
+    }
+
+    //Куски идут по порядку, первая ошибка - в первом куске с ошибками
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        if (errors[t].count && !report.badRecords)
+            report.firstBadRecord = errors[t].first;
+        report.badRecords += errors[t].count;
+    }
+
+    return fleet;
+}
+
+
+
+
+//Далее следует разбор двоичного манифеста
+
+
+static Fleet* ProvisionBinary(const char* data, size_t size, unsigned int threads, ProvisionReport& report)
+{
+    ProvisionHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != PROVISION_VERSION || header.recordSize < sizeof(ProvisionRecord))
+    {
+        report.error = "неподдерживаемая версия двоичного манифеста";
+        return NULL;
+    }
+
+    if ((size - sizeof(header)) / header.recordSize < header.count)
+    {
+        report.error = "двоичный манифест короче заявленного количества записей";
+        return NULL;
+    }
+
+    unsigned int count = header.count;
+    const char* records = data + sizeof(header);
+
+    size_t length = (size_t)count * header.recordSize;
+    if (threads > length / PROVISION_MIN_CHUNK)
+        threads = length / PROVISION_MIN_CHUNK;
+    if (!threads)
+        threads = 1;
+
+    Fleet* fleet = new Fleet(count);
+
+    std::vector<ProvisionErrors> errors(threads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+        {
+            ProvisionErrors& e = errors[t];
+            e.count = 0;
+            e.first = 0;
+
+            unsigned int from = (unsigned long long)count * t / threads;
+            unsigned int to = (unsigned long long)count * (t + 1) / threads;
+
+            for (unsigned int d = from; d < to; ++d)
+            {
+                ProvisionRecord r;
+                memcpy(&r, records + (size_t)d * header.recordSize, sizeof(r));
+
+                if (r.bus > PROVISION_MAX_BUS || !r.adr || r.adr > 247)
+                {
+                    Fail(e, d);
+                    continue;
+                }
+
+                StoreIdentity(fleet->Cold(d), r.sn, r.vp, r.pp, r.k1, r.k2, r.adr);
+                fleet->SetBus(d, r.bus);
+            }
+        });
+    }
+    for (unsigned int t = 0; t < threads; ++t)
+        workers[t].join();
+
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        if (errors[t].count && !report.badRecords)
+            report.firstBadRecord = errors[t].first;
+        report.badRecords += errors[t].count;
+    }
+
+    return fleet;
+}
+
+
+//Проверка уникальности адресов на каждой шине
+static void CheckAddresses(const Fleet& fleet, ProvisionReport& report)
+{
+    //Ключ: шина и адрес в старших 32 битах, номер счётчика в младших
+    std::vector<unsigned long long> keys;
+    keys.reserve(fleet.Count());
+
+    for (unsigned int d = 0; d < fleet.Count(); ++d)
+    {
+        unsigned short adr;
+        memcpy(&adr, fleet.Cold(d) + RG_ADR, 2);
+
+        //Незаполненные из-за ошибок счётчики не участвуют
+        if (adr)
+            keys.push_back((unsigned long long)(fleet.Bus(d) << 8 | adr) << 32 | d);
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    //Адрес принадлежит счётчику с наименьшим номером
+    size_t owner = 0;
+    for (size_t i = 1; i < keys.size(); ++i)
+    {
+        if ((keys[i] >> 32) != (keys[owner] >> 32))
+        {
+            owner = i;
+            continue;
+        }
+
+        unsigned int device = (unsigned int)keys[i];
+        if (!report.duplicates || device < report.firstDuplicate)
+        {
+            report.firstDuplicate = device;
+            report.duplicateOf = (unsigned int)keys[owner];
+        }
+        ++report.duplicates;
+    }
+}
+
+
+Fleet* ProvisionFleet(const char* path, unsigned int threads, ProvisionReport& report)
+{
+    memset(&report, 0, sizeof(report));
+
+    if (!threads)
+        threads = std::thread::hardware_concurrency();
+    if (!threads)
+        threads = 1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        report.error = "не удалось открыть манифест";
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        report.error = "не удалось определить размер манифеста";
+        return NULL;
+    }
+
+    size_t size = st.st_size;
+    if (!size)
+    {
+        close(fd);
+        return new Fleet(0);
+    }
+
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        report.error = "не удалось отобразить манифест в память";
+        return NULL;
+    }
+
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const char* data = (const char*)mapped;
+    unsigned int magic = 0;
+    if (size >= sizeof(ProvisionHeader))
+        memcpy(&magic, data, sizeof(magic));
+
+    Fleet* fleet = magic == PROVISION_MAGIC
+            ? ProvisionBinary(data, size, threads, report)
+            : ProvisionCsv(data, size, threads, report);
+
+    munmap(mapped, size);
+
+    if (!fleet)
+        return NULL;
+
+    report.devices = fleet->Count() - report.badRecords;
+    CheckAddresses(*fleet, report);
+
+    return fleet;
+}
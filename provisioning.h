@@ -0,0 +1,78 @@
+#ifndef PROVISIONING_H
+#define PROVISIONING_H
+
+#include "fleet.h"
+
+/*
+    Массовое заполнение паспортных данных парка счётчиков из манифеста.
+
+    Манифест отображается в память (mmap) и разбирается параллельно
+    кусками прямо в блок паспортных данных Fleet (Fleet::Cold), минуя
+    MBS_write_registers.
+    Для каждого счётчика заполняются RG_SN, RG_VP, RG_PP, RG_K1, RG_K2,
+    RG_ADR и номер шины; затем проверяется, что адреса на каждой шине
+    не повторяются.
+
+    Текстовый манифест (CSV): одна строка на счётчик, поля разделены
+    запятой или точкой с запятой:
+
+        шина,серийный номер,адрес,k1,k2,версия ПО,дата первичной проверки
+
+    Дата - "ГГГГ-ММ-ДД" или "ГГГГ-ММ-ДД чч:мм:сс" (вместо пробела можно 'T').
+    Первая строка, начинающаяся не с цифры, считается заголовком.
+    Номер счётчика в парке - номер строки данных.
+
+    Двоичный манифест: заголовок ProvisionHeader и следом count записей
+    ProvisionRecord, все числа в порядке байтов LowHigh (как в памяти
+    счётчика на x86 и ARM).
+*/
+
+#define PROVISION_MAGIC     (0x5052544DU)   //"MTRP"
+#define PROVISION_VERSION   (1)
+#define PROVISION_MAX_BUS   (0xFFFFFFU)     //наибольший номер шины
+
+//Заголовок двоичного манифеста
+struct ProvisionHeader
+{
+    unsigned int magic;             //PROVISION_MAGIC
+    unsigned int version;           //PROVISION_VERSION
+    unsigned int count;             //количество записей
+    unsigned int recordSize;        //sizeof(ProvisionRecord)
+};
+
+//Запись двоичного манифеста
+struct ProvisionRecord
+{
+    unsigned int sn;                //серийный номер (RG_SN)
+    unsigned int bus;               //номер шины
+    float k1;                       //калибровочный коэффициент k1 (RG_K1)
+    float k2;                       //калибровочный коэффициент k2 (RG_K2)
+    unsigned short vp;              //версия ПО (RG_VP)
+    unsigned char adr;              //сетевой адрес Modbus (RG_ADR), 1-247
+    unsigned char reserved;
+    unsigned char pp[6];            //дата первичной проверки (RG_PP) в формате регистров времени
+    unsigned char reserved2[6];
+};
+
+static_assert(sizeof(ProvisionRecord) == 32, "ProvisionRecord must be 32 bytes");
+
+
+//Итог загрузки манифеста
+struct ProvisionReport
+{
+    unsigned int devices;           //загружено счётчиков
+    unsigned int badRecords;        //записей с ошибками (счётчик остаётся незаполненным)
+    unsigned int firstBadRecord;    //номер первой ошибочной записи (строки данных CSV, с 0)
+    unsigned int duplicates;        //счётчиков с адресом, уже занятым на той же шине
+    unsigned int firstDuplicate;    //первый такой счётчик
+    unsigned int duplicateOf;       //счётчик, которому адрес принадлежит
+    const char* error;              //причина, по которой манифест не загружен (NULL - загружен)
+};
+
+
+/*Загрузка манифеста path (CSV или двоичный, определяется по заголовку)
+в threads потоков (0 - по числу ядер).
+Возвращает новый парк (освобождается delete) или NULL, причина - в report.error*/
+Fleet* ProvisionFleet(const char* path, unsigned int threads, ProvisionReport& report);
+
+#endif // PROVISIONING_H
@@ -0,0 +1,287 @@
+#include "register_watch.h"
+#include <string.h>
+
+RegisterQueue::RegisterQueue(unsigned int capacity):
+    head(0), tail(0), pending(0), dropped(0)
+{
+    //Размер кольцевого буфера округляется вверх до степени двойки
+    unsigned int size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    ring.resize(size);
+    mask = size - 1;
+}
+
+
+void RegisterQueue::Push(const RegisterEvent& event)
+{
+    if (pending - head.load(std::memory_order_acquire) > mask)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring[pending & mask] = event;
+    ++pending;
+}
+
+
+void RegisterQueue::Publish()
+{
+    tail.store(pending, std::memory_order_release);
+}
+
+
+unsigned int RegisterQueue::Poll(RegisterEvent* events, unsigned int maxCount)
+{
+    unsigned int first = head.load(std::memory_order_relaxed);
+    unsigned int last = tail.load(std::memory_order_acquire);
+
+    unsigned int count = last - first;
+    if (count > maxCount)
+        count = maxCount;
+
+    for (unsigned int i = 0; i < count; ++i)
+        events[i] = ring[(first + i) & mask];
+
+    head.store(first + count, std::memory_order_release);
+
+    return count;
+}
+
+
+
+
+RegisterWatch::RegisterWatch(unsigned int deviceCount):
+    interest(0),
+    dirtyWords(deviceCount, 0),
+    snapshotIndex(deviceCount, 0),
+    tick(0),
+    stamp(0)
+{
+}
+
+
+int RegisterWatch::AddConsumer(unsigned int capacity)
+{
+    consumers.push_back(std::unique_ptr<RegisterQueue>(new RegisterQueue(capacity)));
+    consumerTouched.push_back(0);
+
+    return (int)consumers.size() - 1;
+}
+
+
+int RegisterWatch::AddSubscription(int consumer, unsigned char offset, unsigned char size,
+                                   char isThreshold, unsigned int mask, unsigned int threshold)
+{
+    //Регистры двух- или четырёхбайтовые и выровнены на границу слова
+    if (consumer < 0 || consumer >= (int)consumers.size()
+            || (size != 2 && size != 4) || (offset & 1) || offset + size > ALL_MEMORY_SIZE)
+        return -1;
+
+    Subscription s;
+    s.consumer = consumer;
+    s.offset = offset;
+    s.size = size;
+    s.isThreshold = isThreshold;
+    s.mask = mask;
+    s.threshold = threshold;
+    s.stamp = 0;
+    s.words = (size == 4 ? 3ULL : 1ULL) << (offset / 2);
+
+    int id = (int)subscriptions.size();
+    subscriptions.push_back(s);
+
+    for (unsigned int w = offset / 2; w < (unsigned int)(offset + size) / 2; ++w)
+        subscriptionsByWord[w].push_back(id);
+
+    interest |= s.words;
+
+    return id;
+}
+
+
+int RegisterWatch::Subscribe(int consumer, unsigned char offset, unsigned char size, unsigned int mask)
+{
+    return AddSubscription(consumer, offset, size, 0, mask, 0);
+}
+
+
+int RegisterWatch::SubscribeThreshold(int consumer, unsigned char offset, unsigned char size, unsigned int threshold)
+{
+    return AddSubscription(consumer, offset, size, 1, 0, threshold);
+}
+
+
+void RegisterWatch::Unsubscribe(int subscription)
+{
+    if (subscription < 0 || subscription >= (int)subscriptions.size()
+            || subscriptions[subscription].consumer < 0)
+        return;
+
+    subscriptions[subscription].consumer = -1;
+
+    //Пересчёт маски интересующих слов памяти
+    interest = 0;
+    for (unsigned int w = 0; w < ALL_MEMORY_SIZE / 2; ++w)
+    {
+        std::vector<int>& list = subscriptionsByWord[w];
+        for (unsigned int i = 0; i < list.size(); )
+        {
+            if (list[i] == subscription)
+            {
+                list[i] = list.back();
+                list.pop_back();
+            }
+            else
+                ++i;
+        }
+
+        if (!list.empty())
+            interest |= 1ULL << w;
+    }
+}
+
+
+void RegisterWatch::Touch(unsigned int device, const unsigned char* image, unsigned char offset, unsigned char size)
+{
+    if (!size || device >= dirtyWords.size())
+        return;
+
+    //Маска слов памяти, затрагиваемых записью
+    unsigned int first = offset / 2;
+    unsigned int last = (offset + size - 1) / 2;
+    if (last >= ALL_MEMORY_SIZE / 2)
+        last = ALL_MEMORY_SIZE / 2 - 1;
+
+    unsigned long long words = (~0ULL >> (63 - last)) & (~0ULL << first);
+
+    //Записи в регистры, на которые никто не подписан, ничего не стоят
+    words &= interest;
+    if (!words)
+        return;
+
+    //Снимок памяти делается только при первой записи за такт
+    if (!dirtyWords[device])
+    {
+        snapshotIndex[device] = (unsigned int)dirtyDevices.size();
+        dirtyDevices.push_back(device);
+
+        if (snapshots.size() < dirtyDevices.size() * ALL_MEMORY_SIZE)
+            snapshots.resize(dirtyDevices.size() * ALL_MEMORY_SIZE);
+
+        memcpy(&snapshots[snapshotIndex[device] * ALL_MEMORY_SIZE], image, ALL_MEMORY_SIZE);
+    }
+
+    dirtyWords[device] |= words;
+}
+
+
+//Чтение значения регистра размером 2 или 4 байта из памяти
+static inline unsigned int RegisterValue(const unsigned char* image, unsigned char offset, unsigned char size)
+{
+    if (size == 2)
+    {
+        unsigned short value;
+        memcpy(&value, image + offset, 2);
+        return value;
+    }
+
+    unsigned int value;
+    memcpy(&value, image + offset, 4);
+    return value;
+}
+
+
+void RegisterWatch::EndTick(void (*load)(void*, unsigned int, unsigned char*), void* context)
+{
+    unsigned char current[ALL_MEMORY_SIZE];
+
+    for (unsigned int i = 0; i < dirtyDevices.size(); ++i)
+    {
+        unsigned int device = dirtyDevices[i];
+        const unsigned char* old = &snapshots[i * ALL_MEMORY_SIZE];
+        unsigned long long words = dirtyWords[device];
+        dirtyWords[device] = 0;
+
+        //Запись могла не изменить память
+        load(context, device, current);
+        if (!memcmp(old, current, ALL_MEMORY_SIZE))
+            continue;
+
+        //Отметка нужна, чтобы подписка на четырёхбайтовый регистр
+        //не сработала дважды по двум изменённым словам
+        ++stamp;
+
+        while (words)
+        {
+            unsigned int w = __builtin_ctzll(words);
+            words &= words - 1;
+
+            const std::vector<int>& list = subscriptionsByWord[w];
+            for (unsigned int j = 0; j < list.size(); ++j)
+            {
+                Subscription& s = subscriptions[list[j]];
+                if (s.stamp == stamp)
+                    continue;
+                s.stamp = stamp;
+
+                unsigned int oldValue = RegisterValue(old, s.offset, s.size);
+                unsigned int newValue = RegisterValue(current, s.offset, s.size);
+
+                char fired;
+                if (s.isThreshold)
+                    fired = (oldValue >= s.threshold) != (newValue >= s.threshold);
+                else
+                    fired = ((oldValue ^ newValue) & s.mask) != 0;
+
+                if (!fired)
+                    continue;
+
+                RegisterEvent event;
+                event.device = device;
+                event.tick = tick;
+                event.subscription = list[j];
+                event.offset = s.offset;
+                event.oldValue = oldValue;
+                event.newValue = newValue;
+
+                consumers[s.consumer]->Push(event);
+                consumerTouched[s.consumer] = 1;
+            }
+        }
+    }
+
+    dirtyDevices.clear();
+
+    //Каждый потребитель получает события такта одной пачкой
+    for (unsigned int c = 0; c < consumers.size(); ++c)
+    {
+        if (consumerTouched[c])
+        {
+            consumers[c]->Publish();
+            consumerTouched[c] = 0;
+        }
+    }
+
+    ++tick;
+}
+
+
+unsigned int RegisterWatch::Poll(int consumer, RegisterEvent* events, unsigned int maxCount)
+{
+    if (consumer < 0 || consumer >= (int)consumers.size())
+        return 0;
+
+    return consumers[consumer]->Poll(events, maxCount);
+}
+
+
+unsigned int RegisterWatch::Dropped(int consumer) const
+{
+    if (consumer < 0 || consumer >= (int)consumers.size())
+        return 0;
+
+    return consumers[consumer]->Dropped();
+}
@@ -0,0 +1,141 @@
+#ifndef REGISTER_WATCH_H
+#define REGISTER_WATCH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "modbus_device.h"
+
+/*
+    Подписка на изменения регистров счётчиков.
+
+    Потребители (интерфейс, журналы, выгрузка тревог) подписываются на
+    конкретный регистр (например, биты F_TP/F_MG/F_R регистра RG_FL или
+    порог показаний RG_TV), а не перечитывают и не сравнивают всю память.
+
+    Запись в регистры отмечается вызовом Touch до изменения памяти.
+    За такт изменения одного регистра склеиваются: в событие попадают
+    значение на начало такта и значение на его конец. В конце такта (EndTick)
+    проверяются только изменённые счётчики и только подписки на изменённые
+    регистры, так что стоимость пропорциональна числу изменений.
+
+    События доставляются пачками (одна пачка на такт) через очередь без
+    блокировок: один писатель - поток моделирования, один читатель - поток
+    потребителя. Touch, EndTick, Subscribe и Unsubscribe вызываются только
+    из потока моделирования, Poll - только из потока своего потребителя.
+    Потребители регистрируются до запуска потоков потребителей.
+*/
+
+//Событие изменения регистра
+struct RegisterEvent
+{
+    unsigned int device;        //номер счётчика
+    unsigned int tick;          //номер такта, на котором произошло изменение
+    int subscription;           //идентификатор сработавшей подписки
+    unsigned char offset;       //смещение регистра в байтах (RG_*)
+    unsigned int oldValue;      //значение регистра на начало такта
+    unsigned int newValue;      //значение регистра на конец такта
+};
+
+
+//Очередь событий одного потребителя (один писатель, один читатель)
+class RegisterQueue
+{
+    std::vector<RegisterEvent> ring;        //кольцевой буфер, размер - степень двойки
+    unsigned int mask;                      //маска индекса в кольцевом буфере
+    std::atomic<unsigned int> head;         //позиция чтения (изменяет читатель)
+    std::atomic<unsigned int> tail;         //опубликованная позиция записи (изменяет писатель)
+    unsigned int pending;                   //неопубликованная позиция записи
+    std::atomic<unsigned int> dropped;      //число событий, потерянных из-за переполнения
+public:
+    explicit RegisterQueue(unsigned int capacity);
+
+    //Добавить событие в текущую пачку (поток писателя)
+    void Push(const RegisterEvent& event);
+
+    //Сделать текущую пачку видимой читателю (поток писателя)
+    void Publish();
+
+    //Забрать до maxCount событий, возвращает их количество (поток читателя)
+    unsigned int Poll(RegisterEvent* events, unsigned int maxCount);
+
+    unsigned int Dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+
+class RegisterWatch
+{
+    //Подписка на регистр
+    struct Subscription
+    {
+        int consumer;               //потребитель, получающий события (-1 - подписка снята)
+        unsigned char offset;       //смещение регистра в байтах
+        unsigned char size;         //размер регистра в байтах (2 или 4)
+        char isThreshold;           //срабатывать при пересечении порога, а не при изменении битов
+        unsigned int mask;          //маска отслеживаемых битов
+        unsigned int threshold;     //порог для isThreshold
+        unsigned long long stamp;   //отметка последней проверки (против повторного срабатывания)
+        unsigned long long words;   //маска двухбайтовых слов памяти, занимаемых регистром
+    };
+
+    std::vector<std::unique_ptr<RegisterQueue>> consumers;
+    std::vector<Subscription> subscriptions;
+
+    //Подписки, проиндексированные по словам памяти
+    std::vector<int> subscriptionsByWord[ALL_MEMORY_SIZE / 2];
+
+    //Маска слов памяти, на которые есть хотя бы одна подписка
+    unsigned long long interest;
+
+    //Состояние текущего такта
+    std::vector<unsigned long long> dirtyWords;     //изменённые слова каждого счётчика
+    std::vector<unsigned int> snapshotIndex;        //номер снимка памяти каждого изменённого счётчика
+    std::vector<unsigned int> dirtyDevices;         //список изменённых за такт счётчиков
+    std::vector<unsigned char> snapshots;           //снимки памяти на начало такта
+    std::vector<char> consumerTouched;              //потребители, получившие события за такт
+
+    unsigned int tick;
+    unsigned long long stamp;
+
+    int AddSubscription(int consumer, unsigned char offset, unsigned char size,
+                        char isThreshold, unsigned int mask, unsigned int threshold);
+public:
+    explicit RegisterWatch(unsigned int deviceCount);
+
+    //Зарегистрировать потребителя событий, возвращает его идентификатор
+    int AddConsumer(unsigned int capacity = 4096);
+
+    //Подписка на изменение битов mask регистра размером size байт по смещению offset
+    int Subscribe(int consumer, unsigned char offset, unsigned char size, unsigned int mask = 0xFFFFFFFFU);
+
+    //Подписка на пересечение значением регистра порога threshold в любую сторону
+    int SubscribeThreshold(int consumer, unsigned char offset, unsigned char size, unsigned int threshold);
+
+    void Unsubscribe(int subscription);
+
+    //Есть ли подписки на регистры в диапазоне [offset, offset+size)
+    bool IsWatched(unsigned char offset, unsigned char size) const
+    {
+        unsigned int last = (offset + size - 1) / 2;
+        return size && (interest & (~0ULL >> (63 - last)) & (~0ULL << (offset / 2)));
+    }
+
+    //Отметить запись в память счётчика device в диапазоне [offset, offset+size).
+    //Вызывается до изменения памяти: image - память счётчика до записи
+    void Touch(unsigned int device, const unsigned char* image, unsigned char offset, unsigned char size);
+
+    /*Завершение такта: формирование и публикация событий.
+    Функция load должна скопировать текущую память счётчика device в image:
+    void load(void* context, unsigned int device, unsigned char* image);*/
+    void EndTick(void (*load)(void*, unsigned int, unsigned char*), void* context);
+
+    //Забрать события потребителя (поток потребителя)
+    unsigned int Poll(int consumer, RegisterEvent* events, unsigned int maxCount);
+
+    //Число событий потребителя, потерянных из-за переполнения очереди
+    unsigned int Dropped(int consumer) const;
+
+    unsigned int Tick() const { return tick; }
+};
+
+#endif // REGISTER_WATCH_H
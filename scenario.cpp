@@ -0,0 +1,451 @@
+#include "scenario.h"
+#include "alarm_table.h"
+#include "fleet.h"
+#include "Modbus/counter_rng.h"
+#include <algorithm>
+#include <charconv>
+#include <stdio.h>
+#include <string.h>
+
+
+#define SCENARIO_MAX_TOKENS (12)
+
+
+//Разбиение строки [p, end) на слова до комментария
+static unsigned int SplitLine(const char* p, const char* end, const char** begins, const char** ends)
+{
+    unsigned int count = 0;
+    while (p < end && *p != '#')
+    {
+        if (*p == ' ' || *p == '\t' || *p == '\r')
+        {
+            ++p;
+            continue;
+        }
+
+        const char* word = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#')
+            ++p;
+
+        if (count == SCENARIO_MAX_TOKENS)
+            return SCENARIO_MAX_TOKENS + 1;
+
+        begins[count] = word;
+        ends[count] = p;
+        ++count;
+    }
+
+    return count;
+}
+
+
+static bool IsWord(const char* begin, const char* end, const char* word)
+{
+    size_t size = strlen(word);
+    return (size_t)(end - begin) == size && !memcmp(begin, word, size);
+}
+
+
+//Целое число, занимающее слово целиком
+template<typename T>
+static bool ParseInteger(const char* begin, const char* end, T& value)
+{
+    std::from_chars_result result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+
+//Длительность: число с единицей ms, s, m, h или d
+static bool ParseDuration(const char* begin, const char* end, long long& ms)
+{
+    long long value;
+    std::from_chars_result result = std::from_chars(begin, end, value);
+    if (result.ec != std::errc() || value < 0)
+        return false;
+
+    long long unit;
+    if (IsWord(result.ptr, end, "ms"))
+        unit = 1;
+    else if (IsWord(result.ptr, end, "s"))
+        unit = 1000;
+    else if (IsWord(result.ptr, end, "m"))
+        unit = 60000;
+    else if (IsWord(result.ptr, end, "h"))
+        unit = 3600000;
+    else if (IsWord(result.ptr, end, "d"))
+        unit = 86400000;
+    else
+        return false;
+
+    if (value > (1LL << 52) / unit)
+        return false;
+
+    ms = value * unit;
+    return true;
+}
+
+
+//Дата "ГГГГ-ММ-ДД" в мс от 01.01.2000
+static bool ParseStart(const char* begin, const char* end, long long& ms)
+{
+    unsigned int year, month, day;
+    if (end - begin != 10 || begin[4] != '-' || begin[7] != '-'
+            || !ParseInteger(begin, begin + 4, year)
+            || !ParseInteger(begin + 5, begin + 7, month)
+            || !ParseInteger(begin + 8, end, day))
+        return false;
+
+    //Високосным MakeDateTime считает каждый четвёртый год, что верно только до 2099 года
+    if (year < 2000 || year > 2099 || !month || month > 12 || !day || day > 31)
+        return false;
+
+    unsigned char dateTime[DATETIME_SIZE] = { 0, 0, 0, (unsigned char)day, (unsigned char)month, (unsigned char)(year - 2000) };
+    long long seconds = DateTimeSeconds(dateTime);
+
+    //Несуществующий день (31.04, 30.02) перешёл бы в следующий месяц: обратный перевод даёт другую дату
+    unsigned char check[DATETIME_SIZE];
+    MakeDateTime(seconds, check);
+    if (memcmp(check, dateTime, DATETIME_SIZE))
+        return false;
+
+    ms = seconds * 1000;
+    return true;
+}
+
+
+Scenario::Scenario():
+    next(0),
+    begin(0),
+    seed(0),
+    isSeedFixed(false),
+    start(0),
+    tickMs(1000),
+    durationMs(0),
+    error(NULL),
+    errorLine(0)
+{
+}
+
+
+bool Scenario::Compile(const char* text, unsigned int size, unsigned int count)
+{
+    events.clear();
+    next = 0;
+    if (!isSeedFixed)
+        seed = 0;
+    start = 0;
+    tickMs = 1000;
+    durationMs = 0;
+    error = NULL;
+    errorLine = 0;
+
+    //Правила разбираются целиком до выбора счётчиков, потому что seed может стоять после них
+    struct Rule
+    {
+        unsigned char action;
+        unsigned int value;
+        long long stopAfter;            //для reverse: окончание через столько мс (-1 - без окончания)
+        char selection;                 //'a' - все, '%' - доля, 'n' - количество
+        double fraction;
+        unsigned int amount;
+        unsigned int first, last;
+        long long from, to;             //to = from для at
+        unsigned int line;
+    };
+    std::vector<Rule> rules;
+
+    const char* end = text + size;
+    const char* p = text;
+    unsigned int line = 0;
+
+    while (p < end)
+    {
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (!lineEnd)
+            lineEnd = end;
+        ++line;
+
+        const char* begins[SCENARIO_MAX_TOKENS];
+        const char* ends[SCENARIO_MAX_TOKENS];
+        unsigned int words = SplitLine(p, lineEnd, begins, ends);
+        p = lineEnd + 1;
+
+        if (!words)
+            continue;
+
+        errorLine = line;
+        if (words > SCENARIO_MAX_TOKENS)
+        {
+            error = "слишком длинная строка";
+            return false;
+        }
+
+        const char* word = begins[0];
+        const char* wordEnd = ends[0];
+
+        //Параметры моделирования
+        if (IsWord(word, wordEnd, "seed") || IsWord(word, wordEnd, "start")
+                || IsWord(word, wordEnd, "tick") || IsWord(word, wordEnd, "duration"))
+        {
+            long long ms = 0;
+            bool isValid = words == 2;
+            if (isValid && IsWord(word, wordEnd, "seed"))
+            {
+                unsigned long long value = 0;
+                isValid = ParseInteger(begins[1], ends[1], value);
+                if (!isSeedFixed)
+                    seed = value;
+            }
+            else if (isValid && IsWord(word, wordEnd, "start"))
+                isValid = ParseStart(begins[1], ends[1], start);
+            else if (isValid && IsWord(word, wordEnd, "tick"))
+            {
+                isValid = ParseDuration(begins[1], ends[1], ms) && ms > 0 && ms <= 0xFFFFFFFFLL;
+                tickMs = (unsigned int)ms;
+            }
+            else if (isValid)
+                isValid = ParseDuration(begins[1], ends[1], durationMs);
+
+            if (!isValid)
+            {
+                error = "неверное значение параметра";
+                return false;
+            }
+            continue;
+        }
+
+        //Правило: действие [аргумент] выборка [of первый-последний] at T | between T1 T2 [for D]
+        Rule rule = {};
+        rule.stopAfter = -1;
+        rule.first = 0;
+        rule.last = count ? count - 1 : 0;
+        rule.line = line;
+
+        unsigned int i = 1;
+        if (IsWord(word, wordEnd, "crack"))
+            rule.action = SCENARIO_CRACK;
+        else if (IsWord(word, wordEnd, "magnet"))
+            rule.action = SCENARIO_MAGNET;
+        else if (IsWord(word, wordEnd, "button"))
+            rule.action = SCENARIO_BUTTON;
+        else if (IsWord(word, wordEnd, "stop"))
+            rule.action = SCENARIO_STOP;
+        else if (IsWord(word, wordEnd, "reverse"))
+            rule.action = SCENARIO_REVERSE;
+        else if (IsWord(word, wordEnd, "flow"))
+        {
+            rule.action = SCENARIO_FLOW;
+            if (i >= words || !ParseInteger(begins[i], ends[i], rule.value))
+            {
+                error = "неверный расход";
+                return false;
+            }
+            ++i;
+        }
+        else
+        {
+            error = "неизвестное действие";
+            return false;
+        }
+
+        //Выборка
+        if (i >= words)
+        {
+            error = "нет выборки счётчиков";
+            return false;
+        }
+        if (IsWord(begins[i], ends[i], "all"))
+            rule.selection = 'a';
+        else if (ends[i] - begins[i] > 1 && ends[i][-1] == '%')
+        {
+            std::from_chars_result result = std::from_chars(begins[i], ends[i] - 1, rule.fraction);
+            if (result.ec != std::errc() || result.ptr != ends[i] - 1 || rule.fraction < 0 || rule.fraction > 100)
+            {
+                error = "неверная доля счётчиков";
+                return false;
+            }
+            rule.selection = '%';
+            rule.fraction /= 100;
+        }
+        else if (ParseInteger(begins[i], ends[i], rule.amount))
+            rule.selection = 'n';
+        else
+        {
+            error = "неверная выборка счётчиков";
+            return false;
+        }
+        ++i;
+
+        //Диапазон номеров счётчиков
+        if (i < words && IsWord(begins[i], ends[i], "of"))
+        {
+            const char* dash = i + 1 < words ? (const char*)memchr(begins[i + 1], '-', ends[i + 1] - begins[i + 1]) : NULL;
+            if (!dash || !ParseInteger(begins[i + 1], dash, rule.first) || !ParseInteger(dash + 1, ends[i + 1], rule.last)
+                    || rule.first > rule.last || rule.last >= count)
+            {
+                error = "неверный диапазон счётчиков";
+                return false;
+            }
+            i += 2;
+        }
+
+        //Длительность противотока в конце правила
+        if (rule.action == SCENARIO_REVERSE && words > i + 2 && IsWord(begins[words - 2], ends[words - 2], "for"))
+        {
+            if (!ParseDuration(begins[words - 1], ends[words - 1], rule.stopAfter))
+            {
+                error = "неверная длительность противотока";
+                return false;
+            }
+            words -= 2;
+        }
+
+        //Время
+        bool isValid = false;
+        if (i + 2 == words && IsWord(begins[i], ends[i], "at"))
+        {
+            isValid = ParseDuration(begins[i + 1], ends[i + 1], rule.from);
+            rule.to = rule.from;
+        }
+        else if (i + 3 == words && IsWord(begins[i], ends[i], "between"))
+        {
+            isValid = ParseDuration(begins[i + 1], ends[i + 1], rule.from)
+                    && ParseDuration(begins[i + 2], ends[i + 2], rule.to) && rule.from < rule.to;
+        }
+        if (!isValid)
+        {
+            error = "ожидается at T или between T1 T2";
+            return false;
+        }
+
+        rules.push_back(rule);
+    }
+
+    errorLine = 0;
+    if (!count)
+        return true;
+
+    //Выбор счётчиков и моментов событий
+    std::vector<char> isChosen;
+    for (unsigned int r = 0; r < rules.size(); ++r)
+    {
+        const Rule& rule = rules[r];
+        unsigned int range = rule.last - rule.first + 1;
+
+        //Ровно amount счётчиков из диапазона - выборка Флойда без повторов
+        if (rule.selection == 'n' && rule.amount < range)
+        {
+            isChosen.assign(range, 0);
+            for (unsigned int j = range - rule.amount; j < range; ++j)
+            {
+                unsigned int t = (unsigned int)(CounterRandom(seed, r, (1ULL << 32) + j) % (j + 1));
+                isChosen[isChosen[t] ? j : t] = 1;
+            }
+        }
+
+        unsigned long long threshold = CounterThreshold(rule.fraction);
+        unsigned long long window = rule.to - rule.from;
+
+        for (unsigned int k = 0; k < range; ++k)
+        {
+            unsigned int d = rule.first + k;
+            unsigned long long random = CounterRandom(seed, r, d);
+
+            if (rule.selection == '%' && (random & 0xFFFFFFFFULL) >= threshold)
+                continue;
+            if (rule.selection == 'n' && rule.amount < range && !isChosen[k])
+                continue;
+
+            ScenarioEvent event;
+            event.time = rule.from + (window ? (long long)((random >> 32) % window) : 0);
+            event.device = d;
+            event.value = rule.value;
+            event.action = rule.action;
+            events.push_back(event);
+
+            if (rule.stopAfter >= 0)
+            {
+                event.time += rule.stopAfter;
+                event.action = SCENARIO_STOP;
+                events.push_back(event);
+            }
+        }
+    }
+
+    //Полный ключ сортировки делает порядок одинаковым на любой реализации std::sort
+    std::sort(events.begin(), events.end(), [](const ScenarioEvent& a, const ScenarioEvent& b)
+    {
+        if (a.time != b.time)
+            return a.time < b.time;
+        if (a.device != b.device)
+            return a.device < b.device;
+        if (a.action != b.action)
+            return a.action < b.action;
+        return a.value < b.value;
+    });
+
+    return true;
+}
+
+
+bool Scenario::Load(const char* path, unsigned int count)
+{
+    errorLine = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        error = "не удалось открыть сценарий";
+        return false;
+    }
+
+    std::vector<char> text;
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.insert(text.end(), buffer, buffer + size);
+
+    bool isRead = !ferror(file);
+    fclose(file);
+    if (!isRead)
+    {
+        error = "не удалось прочитать сценарий";
+        return false;
+    }
+
+    return Compile(text.data(), (unsigned int)text.size(), count);
+}
+
+
+void Scenario::Rewind(long long clock)
+{
+    begin = clock;
+    next = 0;
+}
+
+
+void Scenario::Apply(Fleet& fleet, long long clock)
+{
+    unsigned int size = (unsigned int)events.size();
+    while (next < size && begin + events[next].time <= clock)
+    {
+        //Событие получает свой модельный момент, а не конец такта
+        const ScenarioEvent& event = events[next++];
+        long long time = begin + event.time;
+        switch (event.action)
+        {
+        case SCENARIO_STOP:
+            fleet.StopReverse(event.device, time);
+            break;
+
+        case SCENARIO_FLOW:
+            if (event.device < fleet.Count())
+                fleet.SetFlow(event.device, event.value, time);
+            break;
+
+        default:
+            fleet.Affect(event.device, (AffectType)event.action, time);
+            break;
+        }
+    }
+}
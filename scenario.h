@@ -0,0 +1,117 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <vector>
+#include "device_types.h"
+
+class Fleet;
+
+/*
+    Сценарий воздействий на парк счётчиков.
+
+    Текст сценария разбирается один раз (Compile) в плоское расписание
+    событий, отсортированное по модельному времени. Fleet::Tick применяет
+    пачкой все события, срок которых наступил к концу такта, поэтому
+    стоимость сценария пропорциональна числу событий, а не числу тактов
+    и счётчиков. Моделирование идёт так быстро, как позволяет такт,
+    а не в реальном времени.
+
+    Каждое событие передаётся парку со своим модельным моментом: автомат
+    тревог и расход учитывают его, а не конец такта. Поэтому тревоги,
+    отметки времени и показания не зависят от длительности такта
+    (при одинаковом зерне совпадает и контрольная сумма tools/scenario).
+
+    Выбор счётчиков и моментов событий - функция от зерна, номера правила
+    и номера счётчика (см. counter_rng.h), так что один и тот же сценарий
+    с тем же зерном даёт одно и то же расписание на любой сборке.
+
+    Формат: одна инструкция на строку, '#' - комментарий до конца строки.
+
+        seed 42                         зерно (по умолчанию 0)
+        start 2024-01-01                начало моделирования до 2099 года (по умолчанию 01.01.2000)
+        tick 1m                         длительность такта (по умолчанию 1s)
+        duration 7d                     длительность моделирования
+
+        действие выборка [of первый-последний] at T
+        действие выборка [of первый-последний] between T1 T2
+
+    Действия: crack (вскрытие), magnet (сильный магнит), button (магнитная
+    кнопка), reverse (противоток; "for D" в конце правила добавляет его
+    окончание через D), stop (окончание противотока), flow R (расход R мл/с).
+    Выборка: all, N% (каждый счётчик с вероятностью N/100) или N (ровно N
+    счётчиков). Времена и длительности - число с единицей ms, s, m, h или d,
+    отсчитываются от начала моделирования; в between момент события
+    для каждого счётчика равномерно распределён в [T1, T2).
+
+    Пример: "magnet 5% between 3d 4d" - сильный магнит у 5% счётчиков
+    между третьими и четвёртыми сутками.
+*/
+
+//Действия событий расписания
+enum ScenarioAction
+{
+    SCENARIO_CRACK = CRACK,
+    SCENARIO_REVERSE = REVERSE_STREAM,
+    SCENARIO_MAGNET = STRONG_MAGNET,
+    SCENARIO_BUTTON = MAGNET_BUTTON,
+    SCENARIO_STOP,                  //окончание противотока
+    SCENARIO_FLOW                   //установка расхода, value - мл/с
+};
+
+//Событие расписания
+struct ScenarioEvent
+{
+    long long time;                 //мс от начала моделирования
+    unsigned int device;
+    unsigned int value;
+    unsigned char action;           //ScenarioAction
+};
+
+
+class Scenario
+{
+    std::vector<ScenarioEvent> events;  //расписание, по возрастанию time
+    unsigned int next;                  //первое неприменённое событие
+    long long begin;                    //модельное время начала (Fleet::Clock), мс от 01.01.2000
+
+    unsigned long long seed;
+    bool isSeedFixed;                   //зерно задано SetSeed, seed в тексте не учитывается
+    long long start;                    //начало моделирования из сценария, мс от 01.01.2000
+    unsigned int tickMs;
+    long long durationMs;
+
+    const char* error;
+    unsigned int errorLine;
+public:
+    Scenario();
+
+    //Зерно, заменяющее seed из текста сценария (задаётся до Compile)
+    void SetSeed(unsigned long long seed) { this->seed = seed; isSeedFixed = true; }
+
+    /*Разбор текста сценария [text, text+size) для парка из count счётчиков.
+    При ошибке возвращает false, причина - Error(), строка - ErrorLine()*/
+    bool Compile(const char* text, unsigned int size, unsigned int count);
+
+    //Разбор файла сценария
+    bool Load(const char* path, unsigned int count);
+
+    const char* Error() const { return error; }
+    unsigned int ErrorLine() const { return errorLine; }
+
+    unsigned long long Seed() const { return seed; }
+    long long Start() const { return start; }
+    unsigned int TickMs() const { return tickMs; }
+    long long DurationMs() const { return durationMs; }
+
+    const std::vector<ScenarioEvent>& Events() const { return events; }
+    unsigned int Applied() const { return next; }
+    bool IsFinished() const { return next == events.size(); }
+
+    //Начать воспроизведение с модельного момента clock (мс от 01.01.2000)
+    void Rewind(long long clock);
+
+    //Применить к fleet события, срок которых не позже clock (вызывается из Fleet::Tick)
+    void Apply(Fleet& fleet, long long clock);
+};
+
+#endif // SCENARIO_H
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Анализатор записей линии RS-485 (без Qt)
+#
+#-------------------------------------------------
+
+QT -= core gui
+CONFIG += console c++2a
+CONFIG -= app_bundle qt
+
+TARGET = analyzer
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+LIBS += -lpthread
+
+SOURCES += \
+    main.cpp \
+    ../../Modbus/modbus_general.cpp
+
+HEADERS += \
+    ../../Modbus/modbus_general.h \
+    ../../Modbus/modbus_client.h
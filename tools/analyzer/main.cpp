@@ -0,0 +1,585 @@
+/*
+    Анализатор записей линии RS-485.
+
+    Сниффер записывает все байты линии подряд, без границ кадров и без
+    времени. Запись отображается в память и делится на куски по числу
+    потоков. Каждый поток ищет в своём куске кадры: кадр принимается,
+    если его длина соответствует правилам IsValidBufferSizeFromMaster
+    (запрос) или IsValidBufferSizeFromSlave (ответ) и совпадает CRC.
+    Байты между кадрами, не образующие корректного кадра, считаются
+    кадром с ошибкой CRC, если перед ними линия была синхронизирована,
+    иначе - мусором.
+
+    Начало куска поток может разобрать неверно (кусок начинается посреди
+    кадра), поэтому поток учитывает кадры, только начиная с первого
+    запроса после ANALYZER_HEAD_BYTES байт от начала куска. После работы
+    потоков разбор каждого куска продолжается за его границу до этого
+    запроса следующего куска (сшивка кусков), так что каждый байт
+    учитывается ровно один раз и с верным состоянием сопоставления
+    запросов и ответов.
+
+    Итог - по каждому адресу slave-устройства и функции: число запросов
+    и ответов, запросы без ответа, коды исключений, доля кадров с ошибкой
+    CRC и время обмена. В записи нет времени, поэтому время обмена
+    моделируется по скорости линии: передача запроса, интервал t3.5
+    и передача ответа (без времени подготовки ответа устройством).
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Modbus/modbus_general.h"
+#include "Modbus/modbus_client.h"
+
+#define ANALYZER_HEAD_BYTES     (4096)          //начало куска, кадры которого сшиваются с предыдущим
+#define ANALYZER_MIN_CHUNK      (1U << 20)      //минимальный кусок на поток
+
+
+//Вид найденного фрагмента записи
+enum FragmentKind
+{
+    FRAGMENT_REQUEST = 0,   //запрос master
+    FRAGMENT_RESPONSE,      //ответ slave-устройства
+    FRAGMENT_DAMAGED,       //кадр с ошибкой CRC или длины
+    FRAGMENT_GARBAGE        //байты вне кадров
+};
+
+//Фрагмент записи
+struct Fragment
+{
+    unsigned long long position;
+    unsigned int size;
+    unsigned char kind;
+    unsigned char address;
+    unsigned char function;     //код функции как в кадре (с битом исключения)
+    unsigned char exception;    //код исключения для ответа-исключения
+};
+
+
+//Статистика по адресу и функции
+struct SlaveStats
+{
+    unsigned long long requests = 0;
+    unsigned long long responses = 0;
+    unsigned long long noResponse = 0;      //запрос, за которым ответа не последовало
+    unsigned long long unmatched = 0;       //ответ без предшествующего запроса
+    unsigned long long crcErrors = 0;
+    unsigned long long exceptions[16] = { 0 };  //ответы-исключения по кодам (0x0F - прочие)
+    long long timeSum = 0;
+    long long timeMax = 0;
+
+    void Merge(const SlaveStats& s)
+    {
+        requests += s.requests;
+        responses += s.responses;
+        noResponse += s.noResponse;
+        unmatched += s.unmatched;
+        crcErrors += s.crcErrors;
+        for (unsigned int i = 0; i < 16; ++i)
+            exceptions[i] += s.exceptions[i];
+        timeSum += s.timeSum;
+        if (s.timeMax > timeMax)
+            timeMax = s.timeMax;
+    }
+};
+
+
+//Учёт фрагментов: сопоставление запросов и ответов, накопление статистики
+class Analysis
+{
+    long long charTime;
+    long long frameGap;
+
+    bool isPending;
+    unsigned char pendingAddress;
+    unsigned char pendingFunction;
+    unsigned int pendingSize;
+
+    SlaveStats& Stats(unsigned char address, unsigned char function)
+    {
+        return stats[address << 8 | (function & 0x7FU)];
+    }
+public:
+    std::unordered_map<unsigned short, SlaveStats> stats;
+    unsigned long long garbage;
+    unsigned long long bytes;
+
+    Analysis(long long charTime, long long frameGap):
+        charTime(charTime), frameGap(frameGap), isPending(false),
+        pendingAddress(0), pendingFunction(0), pendingSize(0), garbage(0), bytes(0) {}
+
+    //Ожидаемый ответ совпадает по адресу и функции
+    bool Expects(unsigned char address, unsigned char function) const
+    {
+        return isPending && pendingAddress == address && pendingFunction == (function & 0x7FU);
+    }
+
+    //Учесть фрагмент; при count = false меняется только состояние сопоставления
+    void Apply(const Fragment& f, bool count = true)
+    {
+        if (count)
+            bytes += f.size;
+
+        switch (f.kind)
+        {
+        case FRAGMENT_REQUEST:
+            if (isPending && count)
+                Stats(pendingAddress, pendingFunction).noResponse++;
+
+            if (count)
+                Stats(f.address, f.function).requests++;
+
+            //На широковещательный запрос ответа нет
+            isPending = f.address != 0;
+            pendingAddress = f.address;
+            pendingFunction = f.function;
+            pendingSize = f.size;
+            break;
+
+        case FRAGMENT_RESPONSE:
+            if (Expects(f.address, f.function))
+            {
+                if (count)
+                {
+                    SlaveStats& s = Stats(f.address, f.function);
+                    s.responses++;
+                    if (f.function & 0x80U)
+                        s.exceptions[f.exception < 0x0F ? f.exception : 0x0F]++;
+
+                    long long time = (pendingSize + f.size) * charTime + frameGap;
+                    s.timeSum += time;
+                    if (time > s.timeMax)
+                        s.timeMax = time;
+                }
+                isPending = false;
+            }
+            else if (count)
+                Stats(f.address, f.function).unmatched++;
+            break;
+
+        case FRAGMENT_DAMAGED:
+            if (count)
+                Stats(f.address, f.function).crcErrors++;
+
+            //Повреждённый ответ: запрос ответ получил, хоть и испорченный
+            if (Expects(f.address, f.function))
+                isPending = false;
+            break;
+
+        default:
+            if (count)
+                garbage += f.size;
+        }
+    }
+
+    //Забыть ожидаемый ответ
+    void ResetPending() { isPending = false; }
+
+    //Ожидаемого ответа не было
+    void ClosePending()
+    {
+        if (isPending)
+            Stats(pendingAddress, pendingFunction).noResponse++;
+        isPending = false;
+    }
+
+    void Merge(const Analysis& other)
+    {
+        for (std::unordered_map<unsigned short, SlaveStats>::const_iterator it = other.stats.begin();
+             it != other.stats.end(); ++it)
+            stats[it->first].Merge(it->second);
+
+        garbage += other.garbage;
+        bytes += other.bytes;
+    }
+};
+
+
+//Поиск кадров в записи
+class Scanner
+{
+    const unsigned char* data;
+    unsigned long long size;
+
+    //Размер корректного кадра-запроса в начале p (0 - нет)
+    unsigned int RequestAt(const unsigned char* p, unsigned long long avail) const
+    {
+        if (avail < 8 || p[0] > 247)
+            return 0;
+
+        unsigned int frameSize;
+        switch (p[1])
+        {
+        case 0x03:
+        case 0x04:
+        case 0x06:
+            frameSize = 8;
+            break;
+        case 0x10:
+            frameSize = 9 + p[6];
+            break;
+        default:
+            return 0;
+        }
+
+        if (frameSize > avail || !IsValidBufferSizeFromMaster((unsigned char*)p, frameSize))
+            return 0;
+
+        return frameSize;
+    }
+
+    //Размер корректного кадра-ответа в начале p (0 - нет)
+    unsigned int ResponseAt(const unsigned char* p, unsigned long long avail) const
+    {
+        if (avail < 5 || !p[0] || p[0] > 247)
+            return 0;
+
+        unsigned int frameSize;
+        switch (p[1])
+        {
+        case 0x03:
+        case 0x04:
+            frameSize = 5 + p[2];
+            break;
+        case 0x06:
+        case 0x10:
+            frameSize = 8;
+            break;
+        default:
+            frameSize = 5;
+        }
+
+        if (frameSize > avail || !IsValidBufferSizeFromSlave((unsigned char*)p, frameSize))
+            return 0;
+
+        if (CRC16((unsigned char*)p, frameSize - 2) != (unsigned short)(p[frameSize - 1] << 8 | p[frameSize - 2]))
+            return 0;
+
+        return frameSize;
+    }
+
+    //Корректный кадр в позиции position; при неоднозначности выбирается ожидаемый ответ
+    bool FrameAt(unsigned long long position, const Analysis& analysis, Fragment& f) const
+    {
+        const unsigned char* p = data + position;
+        unsigned long long avail = size - position;
+
+        unsigned int request = RequestAt(p, avail);
+        unsigned int response = ResponseAt(p, avail);
+        if (!request && !response)
+            return false;
+
+        f.position = position;
+        f.address = p[0];
+        f.function = p[1];
+        f.exception = 0;
+
+        if (response && (!request || analysis.Expects(p[0], p[1])))
+        {
+            f.kind = FRAGMENT_RESPONSE;
+            f.size = response;
+            if (p[1] & 0x80U)
+                f.exception = p[2];
+        }
+        else
+        {
+            f.kind = FRAGMENT_REQUEST;
+            f.size = request;
+        }
+
+        return true;
+    }
+public:
+    unsigned long long position;
+    bool synced;            //предыдущий фрагмент - корректный кадр, закончившийся в position
+
+    Scanner(const unsigned char* data, unsigned long long size, unsigned long long position):
+        data(data), size(size), position(position), synced(false) {}
+
+    /*Следующий фрагмент; мусор не продолжается дальше limit, чтобы не заходить
+    в чужой кусок. Возвращает false в конце записи*/
+    bool Next(const Analysis& analysis, unsigned long long limit, Fragment& f)
+    {
+        if (position >= size)
+            return false;
+
+        if (FrameAt(position, analysis, f))
+        {
+            position += f.size;
+            synced = true;
+            return true;
+        }
+
+        if (synced)
+        {
+            //После корректного кадра ищется следующий в пределах длины кадра:
+            //байты до него - повреждённый кадр
+            unsigned long long end = std::min(size, position + MODBUS_MAX_FRAME);
+            for (unsigned long long q = position + 1; q < end; ++q)
+            {
+                Fragment next;
+                if (FrameAt(q, analysis, next))
+                {
+                    f.position = position;
+                    f.size = q - position;
+                    f.address = data[position];
+                    f.function = position + 1 < size ? data[position + 1] : 0;
+                    f.exception = 0;
+
+                    //Без правдоподобных адреса и функции это не кадр, а помеха
+                    unsigned char function = f.function & 0x7FU;
+                    bool isFrame = f.address <= 247 && (function == 0x03 || function == 0x04
+                                                        || function == 0x06 || function == 0x10);
+                    f.kind = isFrame ? FRAGMENT_DAMAGED : FRAGMENT_GARBAGE;
+
+                    position = q;
+                    return true;
+                }
+            }
+
+            synced = false;
+        }
+
+        //Синхронизация потеряна: мусор до первого корректного кадра
+        f.position = position;
+        f.kind = FRAGMENT_GARBAGE;
+        f.address = f.function = f.exception = 0;
+
+        unsigned long long q = position + 1;
+        Fragment next;
+        while (q < size && q < limit && !FrameAt(q, analysis, next))
+            ++q;
+
+        f.size = q - position;
+        position = q;
+        return true;
+    }
+};
+
+
+//Результат разбора одного куска
+struct Chunk
+{
+    unsigned long long begin;
+    unsigned long long end;
+
+    Analysis analysis;                  //фрагменты учтённой части куска
+    unsigned long long bodyStart;       //начало учтённой части
+
+    //Состояние разбора на конце куска, с которого продолжается сшивка
+    unsigned long long position;
+    bool synced;
+
+    Chunk(long long charTime, long long frameGap): begin(0), end(0), analysis(charTime, frameGap),
+        bodyStart(0), position(0), synced(false) {}
+};
+
+
+//Запрос, однозначно отличимый от ответа (эхо-ответ на 0x06 совпадает с запросом)
+static bool IsSyncPoint(const Fragment& f)
+{
+    return f.kind == FRAGMENT_REQUEST && f.function != 0x06;
+}
+
+
+/*Разбор куска. Учёт начинается с первого однозначного запроса после
+ANALYZER_HEAD_BYTES байт от начала куска: к этому месту разбор заведомо
+синхронизирован, а предшествующее состояние сопоставления не нужно
+(новый запрос его заменяет). Начало куска учитывает сшивка*/
+static void AnalyzeChunk(const unsigned char* data, unsigned long long size, Chunk* chunk)
+{
+    Scanner scanner(data, size, chunk->begin);
+    unsigned long long headEnd = chunk->begin + ANALYZER_HEAD_BYTES;
+
+    bool isBody = !chunk->begin;
+    chunk->bodyStart = chunk->begin;
+
+    Fragment f;
+    while (scanner.position < chunk->end && scanner.Next(chunk->analysis, chunk->end, f))
+    {
+        if (!isBody && f.position >= headEnd && IsSyncPoint(f))
+        {
+            isBody = true;
+            chunk->bodyStart = f.position;
+            chunk->analysis.ResetPending();
+        }
+
+        chunk->analysis.Apply(f, isBody);
+    }
+
+    if (!isBody)
+        chunk->bodyStart = scanner.position;
+
+    chunk->position = scanner.position;
+    chunk->synced = scanner.synced;
+}
+
+
+/*Сшивка: разбор куска prev продолжается за его конец до начала учтённой
+части куска next, фрагменты и состояние сопоставления - в prev*/
+static void Stitch(const unsigned char* data, unsigned long long size, Chunk& prev, const Chunk& next)
+{
+    Scanner scanner(data, size, prev.position);
+    scanner.synced = prev.synced;
+
+    Fragment f;
+    while (scanner.position < next.bodyStart && scanner.Next(prev.analysis, next.bodyStart, f))
+        prev.analysis.Apply(f);
+
+    //Запрос, на котором начинается next, означает, что ожидаемого ответа не было
+    if (scanner.position == next.bodyStart && next.bodyStart < next.position)
+        prev.analysis.ClosePending();
+}
+
+
+static void Usage()
+{
+    fprintf(stderr,
+            "Использование: analyzer [параметры] файл\n"
+            "Параметры:\n"
+            "  --threads N      число потоков (по умолчанию по числу ядер)\n"
+            "  --baud B         скорость линии для модели времени обмена (по умолчанию 9600)\n"
+            "  --bits N         бит на символ вместе со стартовым и стоповыми (по умолчанию 11)\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    unsigned int baud = 9600;
+    unsigned int bits = 11;
+
+    static const option longOptions[] =
+    {
+        { "threads", required_argument, 0, 't' },
+        { "baud",    required_argument, 0, 'b' },
+        { "bits",    required_argument, 0, 'n' },
+        { "help",    no_argument,       0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "t:b:n:h", longOptions, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 't': threads = atoi(optarg); break;
+        case 'b': baud = atoi(optarg); break;
+        case 'n': bits = atoi(optarg); break;
+        default:
+            Usage();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc || !baud || !bits)
+    {
+        Usage();
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Не удалось открыть %s\n", argv[optind]);
+        return 1;
+    }
+
+    unsigned long long size = st.st_size;
+    if (!size)
+    {
+        printf("Запись пуста\n");
+        return 0;
+    }
+
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        fprintf(stderr, "Не удалось отобразить %s в память\n", argv[optind]);
+        return 1;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const unsigned char* data = (const unsigned char*)mapped;
+    long long charTime = ModbusCharTime(baud, bits);
+    long long frameGap = ModbusFrameGap(baud, bits);
+
+    if (!threads)
+        threads = 1;
+    if (threads > size / ANALYZER_MIN_CHUNK)
+        threads = size / ANALYZER_MIN_CHUNK;
+    if (!threads)
+        threads = 1;
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    std::vector<Chunk> chunks(threads, Chunk(charTime, frameGap));
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        chunks[t].begin = size * t / threads;
+        chunks[t].end = size * (t + 1) / threads;
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+        workers.emplace_back(AnalyzeChunk, data, size, &chunks[t]);
+    for (unsigned int t = 0; t < threads; ++t)
+        workers[t].join();
+
+    Analysis total(charTime, frameGap);
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        if (t + 1 < threads)
+            Stitch(data, size, chunks[t], chunks[t + 1]);
+        total.Merge(chunks[t].analysis);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    munmap(mapped, size);
+
+    //Вывод по возрастанию адреса и функции
+    std::vector<unsigned short> keys;
+    for (std::unordered_map<unsigned short, SlaveStats>::iterator it = total.stats.begin(); it != total.stats.end(); ++it)
+        keys.push_back(it->first);
+    std::sort(keys.begin(), keys.end());
+
+    printf("Записано байт: %llu, разобрано за %.2f с (%.0f МБ/с, потоков: %u)\n",
+           size, elapsed, size / elapsed / 1e6, threads);
+    printf("Байт вне кадров: %llu\n", total.garbage);
+    printf("Время обмена - модель по скорости %u бит/с: запрос, t3.5, ответ\n\n", baud);
+    printf("Адрес Функция   Запросы    Ответы Без ответа Без запроса  Ошибки CRC  Доля CRC  Время ср/макс, мкс  Исключения\n");
+
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        const SlaveStats& s = total.stats[keys[i]];
+
+        unsigned long long frames = s.requests + s.responses + s.unmatched + s.crcErrors;
+        double crcRate = frames ? 100.0 * s.crcErrors / frames : 0;
+
+        printf("%5u   0x%02X %9llu %9llu %10llu %11llu %11llu %8.3f%% %9lld/%-9lld ",
+               keys[i] >> 8, keys[i] & 0xFFU, s.requests, s.responses, s.noResponse, s.unmatched,
+               s.crcErrors, crcRate, s.responses ? s.timeSum / (long long)s.responses : 0, s.timeMax);
+
+        for (unsigned int e = 1; e < 16; ++e)
+        {
+            if (s.exceptions[e])
+                printf(" %02X:%llu", e, s.exceptions[e]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+    Шлюз Modbus TCP - RTU.
+
+    Принимает клиентов Modbus TCP и передаёт их запросы на шины RTU:
+    последовательные порты и pty (--bus /dev/ttyX:1-10) или виртуальные
+    шины ModbusLine с моделируемыми счётчиками (--bus sim:1-10).
+    Устройство на шине выбирается полем unit заголовка MBAP.
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Modbus/modbus_client.h"
+#include "Modbus/modbus_line.h"
+#include "Modbus/modbus_gateway.h"
+#include "modbus_device.h"
+
+
+struct Options
+{
+    unsigned short port = 502;
+    const char* host = NULL;
+    std::vector<std::string> buses;
+    double statsInterval = 0;
+    DeviceRegime regime = TECHNOLOGICAL;    //режим виртуальных счётчиков (права записи регистров)
+    ModbusClientConfig client;
+    ModbusLineConfig line;
+    ModbusGatewayConfig gateway;
+};
+
+
+static ModbusLoop loop;
+static std::vector<std::unique_ptr<ModbusLine>> lines;
+static std::vector<std::unique_ptr<ModbusClient>> clients;
+static std::vector<std::vector<unsigned char>> memories;
+
+
+//Разбор описания шины "путь:первый-последний" (без диапазона - все адреса 1-247)
+static bool AddBus(ModbusGateway& gateway, const Options& o, const std::string& spec)
+{
+    std::string path = spec;
+    unsigned int first = 1, last = 247;
+
+    size_t colon = spec.rfind(':');
+    if (colon != std::string::npos && colon + 1 < spec.size() && spec[colon + 1] >= '0' && spec[colon + 1] <= '9')
+    {
+        path = spec.substr(0, colon);
+        first = atoi(spec.c_str() + colon + 1);
+
+        const char* dash = strchr(spec.c_str() + colon + 1, '-');
+        last = dash ? atoi(dash + 1) : first;
+    }
+
+    if (!first || last > 247 || last < first)
+        return false;
+
+    clients.emplace_back(new ModbusClient(loop, o.client));
+    ModbusClient* client = clients.back().get();
+
+    if (path == "sim")
+    {
+        lines.emplace_back(new ModbusLine(loop, o.line));
+        ModbusLine* line = lines.back().get();
+
+        for (unsigned int address = first; address <= last; ++address)
+        {
+            memories.push_back(std::vector<unsigned char>(ALL_MEMORY_SIZE, 0));
+            memories.back()[RG_ADR] = (unsigned char)address;
+
+            //Размер памяти - в двухбайтовых регистрах (адреса в кадрах при этом - смещения в байтах)
+            line->AddSlave((unsigned char)address, memories.back().data(), ALL_MEMORY_SIZE / 2, 0,
+                           IsDeviceWritable, (void*)&o.regime);
+        }
+
+        if (!client->AttachRtu(line->OpenSocket()))
+            return false;
+    }
+    else if (!client->OpenRtu(path.c_str()))
+        return false;
+
+    unsigned int bus = gateway.AddBus(client);
+    gateway.Route((unsigned char)first, (unsigned char)last, bus);
+
+    printf("Шина %u: %s, устройства %u-%u\n", bus, path.c_str(), first, last);
+    return true;
+}
+
+
+static void Stats(ModbusGateway* gateway, long long interval)
+{
+    printf("Клиентов: %u, запросов: %llu, на шины: %llu, объединено: %llu, из кэша: %llu, отклонено: %llu\n",
+           gateway->Connections(), gateway->Requests(), gateway->Forwarded(),
+           gateway->Merged(), gateway->Cached(), gateway->Rejected());
+    fflush(stdout);
+
+    loop.AddTimer(ModbusLoop::Now() + interval, [gateway, interval]() { Stats(gateway, interval); });
+}
+
+
+static void Usage()
+{
+    fprintf(stderr,
+            "Использование: gateway [параметры] --bus шина [--bus шина ...]\n"
+            "Шины:\n"
+            "  /dev/ttyX[:A-B]          последовательный порт или pty с устройствами A-B\n"
+            "  sim[:A-B]                виртуальная шина с моделируемыми счётчиками A-B\n"
+            "Параметры:\n"
+            "  --port P                 порт Modbus TCP (по умолчанию 502)\n"
+            "  --host H                 адрес интерфейса (по умолчанию все)\n"
+            "  --baud B                 скорость шин RTU (по умолчанию 9600)\n"
+            "  --parity N|E|O           чётность (по умолчанию E)\n"
+            "  --turnaround US          время подготовки ответа на виртуальной шине, мкс\n"
+            "  --timeout US             время ожидания ответа, мкс (0 - по скорости линии)\n"
+            "  --retries N              число повторов на шине (по умолчанию 2)\n"
+            "  --ttl MS                 время жизни ответа в кэше, мс (0 - кэш выключен, по умолчанию 100)\n"
+            "  --max-queued N           предел запросов клиента в очереди шины (по умолчанию 64)\n"
+            "  --stats S                печатать статистику каждые S секунд\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options o;
+
+    static const option longOptions[] =
+    {
+        { "port",       required_argument, 0, 'P' },
+        { "host",       required_argument, 0, 'h' },
+        { "bus",        required_argument, 0, 'B' },
+        { "baud",       required_argument, 0, 'b' },
+        { "parity",     required_argument, 0, 'p' },
+        { "turnaround", required_argument, 0, 'T' },
+        { "timeout",    required_argument, 0, 'o' },
+        { "retries",    required_argument, 0, 'R' },
+        { "ttl",        required_argument, 0, 't' },
+        { "max-queued", required_argument, 0, 'q' },
+        { "stats",      required_argument, 0, 's' },
+        { "help",       no_argument,       0, 'H' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "P:h:B:b:p:T:o:R:t:q:s:H", longOptions, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'P': o.port = (unsigned short)atoi(optarg); break;
+        case 'h': o.host = optarg; break;
+        case 'B': o.buses.push_back(optarg); break;
+        case 'b': o.client.baud = o.line.baud = atoi(optarg); break;
+        case 'p': o.line.parity = optarg[0]; break;
+        case 'T': o.line.turnaroundUs = atoll(optarg); break;
+        case 'o': o.client.timeoutUs = atoll(optarg); break;
+        case 'R': o.client.retries = atoi(optarg); break;
+        case 't': o.gateway.cacheTtlUs = atoll(optarg) * 1000; break;
+        case 'q': o.gateway.maxQueued = atoi(optarg); break;
+        case 's': o.statsInterval = atof(optarg); break;
+        default:
+            Usage();
+            return c == 'H' ? 0 : 1;
+        }
+    }
+
+    if (o.buses.empty())
+    {
+        Usage();
+        return 1;
+    }
+
+    o.client.parity = o.line.parity;
+    o.client.stopBits = o.line.stopBits;
+
+    ModbusGateway gateway(loop, o.gateway);
+
+    for (unsigned int i = 0; i < o.buses.size(); ++i)
+    {
+        if (!AddBus(gateway, o, o.buses[i]))
+        {
+            fprintf(stderr, "Не удалось открыть шину %s\n", o.buses[i].c_str());
+            return 1;
+        }
+    }
+
+    if (!gateway.Listen(o.port, o.host))
+    {
+        fprintf(stderr, "Не удалось открыть порт %hu\n", o.port);
+        return 1;
+    }
+
+    printf("Шлюз принимает подключения на порту %hu\n", o.port);
+    fflush(stdout);
+
+    if (o.statsInterval > 0)
+        Stats(&gateway, (long long)(o.statsInterval * 1000000));
+
+    loop.Run();
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# Генератор нагрузки Modbus (без Qt)
+#
+#-------------------------------------------------
+
+QT -= core gui
+CONFIG += console c++2a
+CONFIG -= app_bundle qt
+
+TARGET = loadgen
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+LIBS += -lpthread
+
+SOURCES += \
+    main.cpp \
+    ../../Modbus/modbus_general.cpp \
+    ../../Modbus/modbus_client.cpp \
+    ../../Modbus/modbus_line.cpp \
+    ../../Modbus/modbus_faults.cpp
+
+HEADERS += \
+    ../../Modbus/modbus_general.h \
+    ../../Modbus/modbus_slave.h \
+    ../../Modbus/modbus_client.h \
+    ../../Modbus/modbus_line.h \
+    ../../Modbus/modbus_faults.h \
+    ../../Modbus/counter_rng.h \
+    ../../modbus_device.h \
+    ../../device_types.h
@@ -0,0 +1,699 @@
+/*
+    Генератор нагрузки Modbus.
+
+    Два режима:
+    - открытый цикл (--rate): запросы отправляются по расписанию с заданной
+      частотой независимо от ответов, задержка отсчитывается от момента
+      по расписанию, поэтому медленный slave не скрывает очередь
+      (нет "согласованного пропуска" измерений); сверх предела
+      незавершённых запросов (--max-outstanding) запросы ждут места,
+      не теряя момента по расписанию, а итог отмечает насыщение;
+    - закрытый цикл (--concurrency): N сеансов, каждый отправляет
+      следующий запрос после ответа на предыдущий.
+
+    Цели: Modbus TCP (tcp:host:port), последовательные порты и pty
+    (rtu:/dev/ttyX[,/dev/ttyY...]) и виртуальные шины в том же процессе
+    (inproc:buses[xslaves]). Каждый поток ведёт свой ModbusLoop, так что
+    нагрузка масштабируется по ядрам. Запросы выбираются из смеси регистров
+    карты RG_*, результат - пропускная способность, коды ошибок и
+    процентили задержки p50/p99/p99.9.
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Modbus/modbus_client.h"
+#include "Modbus/modbus_line.h"
+#include "Modbus/counter_rng.h"
+#include "modbus_device.h"
+
+
+//Регистры карты памяти счётчика: имя, смещение, количество двухбайтовых регистров
+struct RegisterInfo
+{
+    const char* name;
+    unsigned short offset;
+    unsigned short count;
+};
+
+static const RegisterInfo Registers[] =
+{
+    { "SN",  RG_SN,  2 },
+    { "VP",  RG_VP,  1 },
+    { "CS",  RG_CS,  1 },
+    { "PP",  RG_PP,  3 },
+    { "K1",  RG_K1,  2 },
+    { "K2",  RG_K2,  2 },
+    { "ADR", RG_ADR, 1 },
+    { "TV",  RG_TV,  2 },
+    { "PW",  RG_PW,  2 },
+    { "SA",  RG_SA,  1 },
+    { "MA",  RG_MA,  1 },
+    { "TM",  RG_TM,  3 },
+    { "FL",  RG_FL,  1 },
+    { "TP",  RG_TP,  3 },
+    { "MG",  RG_MG,  3 },
+    { "HC",  RG_HC,  1 },
+    { "CC",  RG_CC,  1 },
+};
+
+//Элемент смеси запросов
+struct MixEntry
+{
+    unsigned short address;
+    unsigned short count;
+    unsigned long long bound;   //накопленный вес
+};
+
+
+//Гистограмма задержек в микросекундах: по 64 линейных ячейки на каждую степень двойки
+class Histogram
+{
+    std::vector<unsigned long long> cells;
+    unsigned long long total;
+    long long maximum;
+
+    static unsigned int Index(long long value)
+    {
+        if (value < 64)
+            return value < 0 ? 0 : (unsigned int)value;
+
+        unsigned int exponent = 63 - __builtin_clzll((unsigned long long)value);
+        return (exponent - 5) * 64 + (unsigned int)((value >> (exponent - 6)) & 63);
+    }
+
+    static long long Value(unsigned int index)
+    {
+        if (index < 64)
+            return index;
+
+        unsigned int exponent = index / 64 + 5;
+        return (long long)((64 + index % 64) + 1) << (exponent - 6);
+    }
+public:
+    Histogram(): cells(64 * 60, 0), total(0), maximum(0) {}
+
+    void Add(long long value)
+    {
+        ++cells[Index(value)];
+        ++total;
+        if (value > maximum)
+            maximum = value;
+    }
+
+    void Merge(const Histogram& other)
+    {
+        for (unsigned int i = 0; i < cells.size(); ++i)
+            cells[i] += other.cells[i];
+        total += other.total;
+        if (other.maximum > maximum)
+            maximum = other.maximum;
+    }
+
+    //Значение, не превышаемое долей fraction измерений (с точностью ячейки)
+    long long Percentile(double fraction) const
+    {
+        if (!total)
+            return 0;
+
+        unsigned long long rank = (unsigned long long)(fraction * total);
+        if (rank >= total)
+            rank = total - 1;
+
+        unsigned long long seen = 0;
+        for (unsigned int i = 0; i < cells.size(); ++i)
+        {
+            seen += cells[i];
+            if (seen > rank)
+                return Value(i) < maximum ? Value(i) : maximum;
+        }
+
+        return maximum;
+    }
+
+    unsigned long long Total() const { return total; }
+    long long Maximum() const { return maximum; }
+};
+
+
+//Параметры запуска
+struct Options
+{
+    std::string target;
+    double rate = 0;                    //запросов в секунду (открытый цикл)
+    unsigned int concurrency = 1;       //сеансов на поток (закрытый цикл)
+    unsigned int threads = 1;
+    unsigned int connections = 1;       //соединений TCP на поток
+    double duration = 10;
+    unsigned char firstSlave = 1;
+    unsigned char lastSlave = 1;
+    unsigned int maxOutstanding = 100000;
+    unsigned long long seed = 1;
+    std::vector<MixEntry> mix;
+    unsigned long long mixTotal = 0;
+    ModbusClientConfig client;
+    ModbusLineConfig line;
+    ModbusFaultConfig faults;
+    bool hasFaults = false;
+    DeviceRegime regime = TECHNOLOGICAL;    //режим виртуальных счётчиков (права записи регистров)
+};
+
+
+//Один поток нагрузки
+struct Worker
+{
+    const Options* options;
+    unsigned int index;
+
+    ModbusLoop loop;
+    std::vector<std::unique_ptr<ModbusLine>> lines;
+    std::vector<std::unique_ptr<ModbusClient>> clients;
+    std::vector<std::vector<unsigned char>> memories;
+    std::unique_ptr<ModbusFaults> faults;
+
+    Histogram latency;
+    unsigned long long errors[256];
+    unsigned long long overload;        //запросов, ждавших освобождения места под пределом незавершённых
+    unsigned long long unsent;          //из них не отправлено до завершения потока
+    std::deque<std::pair<long long, ModbusClient*>> deferred;   //запросы, ждущие места: момент по расписанию и шина
+    unsigned long long drainTimer;      //таймер отправки отложенных запросов
+    unsigned long long issued;
+    unsigned long long outstanding;
+    unsigned long long counter;
+
+    long long start;
+    long long end;
+
+    Worker(): index(0), overload(0), unsent(0), drainTimer(0), issued(0), outstanding(0), counter(0), start(0), end(0)
+    {
+        memset(errors, 0, sizeof(errors));
+    }
+};
+
+
+//Следующий запрос из смеси
+static void NextRequest(Worker* w, unsigned char& slave, unsigned short& address, unsigned short& count)
+{
+    const Options& o = *w->options;
+    unsigned long long random = CounterRandom(o.seed, w->index, w->counter++);
+
+    slave = o.firstSlave + (unsigned char)((random >> 32) % (o.lastSlave - o.firstSlave + 1));
+
+    unsigned long long pick = (random & 0xFFFFFFFFULL) % o.mixTotal;
+    for (unsigned int i = 0; i < o.mix.size(); ++i)
+    {
+        if (pick < o.mix[i].bound)
+        {
+            address = o.mix[i].address;
+            count = o.mix[i].count;
+            return;
+        }
+    }
+}
+
+
+static void Record(Worker* w, unsigned char error, long long latency)
+{
+    w->latency.Add(latency);
+    w->errors[error]++;
+}
+
+
+static void Drain(Worker* w);
+
+//Запрос открытого цикла: задержка отсчитывается от момента по расписанию
+static ModbusTask Scheduled(Worker* w, ModbusClient* client, long long intended)
+{
+    unsigned char slave;
+    unsigned short address, count;
+    NextRequest(w, slave, address, count);
+
+    w->outstanding++;
+    ModbusResult result = co_await client->Read(slave, address, count);
+    w->outstanding--;
+
+    Record(w, result.error, ModbusLoop::Now() - intended);
+
+    /*Освободившееся место занимают отложенные запросы, но не отсюда: на закрытом
+    клиенте запрос завершается сразу, и вложенные вызовы росли бы с очередью*/
+    if (!w->deferred.empty() && !w->drainTimer)
+        w->drainTimer = w->loop.AddTimer(0, [w]() { Drain(w); });
+}
+
+
+//Отправка отложенных запросов на освободившиеся места, старейшие первыми;
+//их задержка тоже отсчитывается от момента по расписанию, так что ожидание места входит в неё
+static void Drain(Worker* w)
+{
+    w->drainTimer = 0;
+
+    while (!w->deferred.empty() && w->outstanding < w->options->maxOutstanding)
+    {
+        std::pair<long long, ModbusClient*> next = w->deferred.front();
+        w->deferred.pop_front();
+        Scheduled(w, next.second, next.first);
+    }
+}
+
+
+//Сеанс закрытого цикла
+static ModbusTask Session(Worker* w, ModbusClient* client)
+{
+    w->outstanding++;
+    while (ModbusLoop::Now() < w->end)
+    {
+        unsigned char slave;
+        unsigned short address, count;
+        NextRequest(w, slave, address, count);
+
+        long long sent = ModbusLoop::Now();
+        ModbusResult result = co_await client->Read(slave, address, count);
+        Record(w, result.error, ModbusLoop::Now() - sent);
+        w->issued++;
+
+        //Закрытый клиент завершает запросы сразу - сеанс не должен крутиться до конца времени
+        if (result.error == MODBUS_ERROR_IO)
+            break;
+    }
+    w->outstanding--;
+}
+
+
+//Отправка всех запросов, наступивших по расписанию, и постановка таймера на следующий
+static void Schedule(Worker* w, double interval)
+{
+    long long now = ModbusLoop::Now();
+
+    for (;;)
+    {
+        long long intended = w->start + (long long)(w->issued * interval);
+        if (intended > now || intended >= w->end)
+            break;
+
+        //Сверх предела запросы не отправляются, а ждут места: цель не получает
+        //бесконечную очередь, а измерение не теряет запросы, которые не успели уйти
+        ModbusClient* client = w->clients[w->issued % w->clients.size()].get();
+        if (w->outstanding >= w->options->maxOutstanding || !w->deferred.empty())
+        {
+            w->deferred.push_back(std::make_pair(intended, client));
+            w->overload++;
+        }
+        else
+            Scheduled(w, client, intended);
+
+        w->issued++;
+    }
+
+    long long next = w->start + (long long)(w->issued * interval);
+    if (next < w->end)
+        w->loop.AddTimer(next, [w, interval]() { Schedule(w, interval); });
+}
+
+
+//Завершение потока: после окончания времени ждём ответы не дольше 2 с
+static void Watchdog(Worker* w)
+{
+    long long now = ModbusLoop::Now();
+    if (now >= w->end && ((!w->outstanding && w->deferred.empty()) || now >= w->end + 2000000))
+    {
+        //Так и не отправленные запросы учитываются задержкой не меньше прошедшей с момента по расписанию
+        for (unsigned int i = 0; i < w->deferred.size(); ++i)
+            w->latency.Add(now - w->deferred[i].first);
+        w->unsent = w->deferred.size();
+        w->deferred.clear();
+
+        w->loop.Stop();
+        return;
+    }
+
+    w->loop.AddTimer(now + 10000, [w]() { Watchdog(w); });
+}
+
+
+static bool Connect(Worker* w)
+{
+    const Options& o = *w->options;
+    const std::string& t = o.target;
+
+    if (t.compare(0, 4, "tcp:") == 0)
+    {
+        std::string rest = t.substr(4);
+        size_t colon = rest.rfind(':');
+        std::string host = colon == std::string::npos ? rest : rest.substr(0, colon);
+        unsigned short port = colon == std::string::npos ? 502 : (unsigned short)atoi(rest.c_str() + colon + 1);
+
+        for (unsigned int i = 0; i < o.connections; ++i)
+        {
+            w->clients.emplace_back(new ModbusClient(w->loop, o.client));
+            if (!w->clients.back()->OpenTcp(host.c_str(), port))
+                return false;
+        }
+        return true;
+    }
+
+    if (t.compare(0, 4, "rtu:") == 0)
+    {
+        //Порты делятся между потоками: одну линию RTU может вести только один master
+        std::vector<std::string> ports;
+        size_t position = 4;
+        while (position <= t.size())
+        {
+            size_t comma = t.find(',', position);
+            if (comma == std::string::npos)
+                comma = t.size();
+            ports.push_back(t.substr(position, comma - position));
+            position = comma + 1;
+        }
+
+        for (unsigned int i = w->index; i < ports.size(); i += o.threads)
+        {
+            w->clients.emplace_back(new ModbusClient(w->loop, o.client));
+            if (!w->clients.back()->OpenRtu(ports[i].c_str()))
+                return false;
+        }
+        return !w->clients.empty();
+    }
+
+    if (t.compare(0, 7, "inproc:") == 0)
+    {
+        unsigned int buses = atoi(t.c_str() + 7);
+        if (!buses)
+            buses = 1;
+
+        if (o.hasFaults)
+            w->faults.reset(new ModbusFaults(o.seed, o.faults));
+
+        for (unsigned int b = 0; b < buses; ++b)
+        {
+            w->lines.emplace_back(new ModbusLine(w->loop, o.line));
+            ModbusLine* line = w->lines.back().get();
+
+            for (unsigned int s = o.firstSlave; s <= o.lastSlave; ++s)
+            {
+                w->memories.push_back(std::vector<unsigned char>(ALL_MEMORY_SIZE, 0));
+                //Размер памяти - в двухбайтовых регистрах (адреса в кадрах при этом - смещения в байтах)
+                line->AddSlave((unsigned char)s, w->memories.back().data(), ALL_MEMORY_SIZE / 2, 0,
+                               IsDeviceWritable, (void*)&o.regime);
+            }
+
+            if (w->faults)
+                line->SetFaults(w->faults.get(), w->index * buses + b);
+
+            w->clients.emplace_back(new ModbusClient(w->loop, o.client));
+            if (!w->clients.back()->AttachRtu(line->OpenSocket()))
+                return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+static void Run(Worker* w)
+{
+    const Options& o = *w->options;
+
+    w->start = ModbusLoop::Now();
+    w->end = w->start + (long long)(o.duration * 1000000);
+
+    if (o.rate > 0)
+        Schedule(w, 1000000.0 * o.threads / o.rate);
+    else
+    {
+        for (unsigned int i = 0; i < o.concurrency; ++i)
+            Session(w, w->clients[i % w->clients.size()].get());
+    }
+
+    Watchdog(w);
+    w->loop.Run();
+
+    //Запросы, оставшиеся без ответа к остановке, завершаются ошибкой при закрытии
+    //клиентов; это делается здесь, пока статистика потока жива и ещё не сведена
+    w->clients.clear();
+}
+
+
+static bool ParseMix(Options& o, const char* text)
+{
+    o.mix.clear();
+    o.mixTotal = 0;
+
+    std::string s(text);
+    size_t position = 0;
+    while (position < s.size())
+    {
+        size_t comma = s.find(',', position);
+        if (comma == std::string::npos)
+            comma = s.size();
+
+        std::string item = s.substr(position, comma - position);
+        position = comma + 1;
+
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        unsigned long long weight = colon == std::string::npos ? 1 : strtoull(item.c_str() + colon + 1, NULL, 10);
+
+        if (name.compare(0, 3, "RG_") == 0)
+            name = name.substr(3);
+
+        const RegisterInfo* info = NULL;
+        for (unsigned int i = 0; i < sizeof(Registers) / sizeof(Registers[0]); ++i)
+        {
+            if (name == Registers[i].name)
+                info = &Registers[i];
+        }
+
+        if (!info || !weight)
+        {
+            fprintf(stderr, "Неизвестный регистр или нулевой вес в смеси: %s\n", item.c_str());
+            return false;
+        }
+
+        MixEntry entry;
+        entry.address = info->offset;
+        entry.count = info->count;
+        o.mixTotal += weight;
+        entry.bound = o.mixTotal;
+        o.mix.push_back(entry);
+    }
+
+    return !o.mix.empty();
+}
+
+
+static bool ParseFaults(Options& o, const char* text)
+{
+    std::string s(text);
+    size_t position = 0;
+    while (position < s.size())
+    {
+        size_t comma = s.find(',', position);
+        if (comma == std::string::npos)
+            comma = s.size();
+
+        std::string item = s.substr(position, comma - position);
+        position = comma + 1;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+
+        std::string name = item.substr(0, eq);
+        double value = atof(item.c_str() + eq + 1);
+
+        if (name == "bit")           o.faults.bitError = value;
+        else if (name == "drop")     o.faults.drop = value;
+        else if (name == "late")     o.faults.late = value;
+        else if (name == "lateus")   o.faults.lateUs = (long long)value;
+        else if (name == "failure")  o.faults.failure = value;
+        else if (name == "busy")     o.faults.busy = value;
+        else if (name == "truncate") o.faults.truncate = value;
+        else
+            return false;
+    }
+
+    o.hasFaults = true;
+    return true;
+}
+
+
+static void Usage()
+{
+    fprintf(stderr,
+            "Использование: loadgen [параметры] цель\n"
+            "Цели:\n"
+            "  tcp:host[:port]          Modbus TCP\n"
+            "  rtu:/dev/ttyX[,...]      последовательные порты или pty (делятся между потоками)\n"
+            "  inproc:N                 N виртуальных шин в каждом потоке\n"
+            "Параметры:\n"
+            "  --rate R                 открытый цикл: R запросов в секунду на все потоки\n"
+            "  --concurrency N          закрытый цикл: N сеансов на поток (по умолчанию 1)\n"
+            "  --threads T              число потоков (по умолчанию 1)\n"
+            "  --connections C          соединений TCP на поток (по умолчанию 1)\n"
+            "  --duration S             длительность в секундах (по умолчанию 10)\n"
+            "  --slaves A[-B]           адреса slave-устройств (по умолчанию 1)\n"
+            "  --mix TV:50,FL:30,SN:20  смесь читаемых регистров RG_* с весами (по умолчанию TV)\n"
+            "  --baud B                 скорость линии RTU (по умолчанию 9600)\n"
+            "  --parity N|E|O           чётность (по умолчанию E)\n"
+            "  --turnaround US          время подготовки ответа на виртуальной шине, мкс\n"
+            "  --timeout US             время ожидания ответа, мкс (0 - по скорости линии)\n"
+            "  --retries N              число повторов (по умолчанию 0)\n"
+            "  --inflight N             транзакций TCP в полёте на соединение (по умолчанию 16)\n"
+            "  --max-outstanding N      предел незавершённых запросов открытого цикла на поток\n"
+            "                           (сверх него запросы ждут места, задержка - от момента по расписанию)\n"
+            "  --faults bit=P,drop=P,late=P,lateus=US,failure=P,busy=P,truncate=P\n"
+            "                           неисправности виртуальных шин\n"
+            "  --seed S                 зерно выбора запросов и неисправностей\n"
+            "  --high-low               порядок байтов HighLow\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options o;
+    o.client.retries = 0;
+    ParseMix(o, "TV");
+
+    static const option longOptions[] =
+    {
+        { "rate",            required_argument, 0, 'r' },
+        { "concurrency",     required_argument, 0, 'c' },
+        { "threads",         required_argument, 0, 't' },
+        { "connections",     required_argument, 0, 'C' },
+        { "duration",        required_argument, 0, 'd' },
+        { "slaves",          required_argument, 0, 's' },
+        { "mix",             required_argument, 0, 'm' },
+        { "baud",            required_argument, 0, 'b' },
+        { "parity",          required_argument, 0, 'p' },
+        { "turnaround",      required_argument, 0, 'T' },
+        { "timeout",         required_argument, 0, 'o' },
+        { "retries",         required_argument, 0, 'R' },
+        { "inflight",        required_argument, 0, 'i' },
+        { "max-outstanding", required_argument, 0, 'M' },
+        { "faults",          required_argument, 0, 'f' },
+        { "seed",            required_argument, 0, 'S' },
+        { "high-low",        no_argument,       0, 'H' },
+        { "help",            no_argument,       0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "r:c:t:C:d:s:m:b:p:T:o:R:i:M:f:S:Hh", longOptions, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'r': o.rate = atof(optarg); break;
+        case 'c': o.concurrency = atoi(optarg); break;
+        case 't': o.threads = atoi(optarg); break;
+        case 'C': o.connections = atoi(optarg); break;
+        case 'd': o.duration = atof(optarg); break;
+        case 's':
+        {
+            char* dash = strchr(optarg, '-');
+            o.firstSlave = (unsigned char)atoi(optarg);
+            o.lastSlave = dash ? (unsigned char)atoi(dash + 1) : o.firstSlave;
+            break;
+        }
+        case 'm':
+            if (!ParseMix(o, optarg))
+                return 1;
+            break;
+        case 'b': o.client.baud = o.line.baud = atoi(optarg); break;
+        case 'p': o.line.parity = optarg[0]; break;
+        case 'T': o.line.turnaroundUs = atoll(optarg); break;
+        case 'o': o.client.timeoutUs = atoll(optarg); break;
+        case 'R': o.client.retries = atoi(optarg); break;
+        case 'i': o.client.maxInFlight = atoi(optarg); break;
+        case 'M': o.maxOutstanding = atoi(optarg); break;
+        case 'f':
+            if (!ParseFaults(o, optarg))
+            {
+                fprintf(stderr, "Неверное описание неисправностей: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'S': o.seed = strtoull(optarg, NULL, 10); break;
+        case 'H': o.client.isHighLowOrder = 1; break;
+        default:
+            Usage();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc || !o.threads || !o.concurrency || !o.connections || o.lastSlave < o.firstSlave)
+    {
+        Usage();
+        return 1;
+    }
+
+    o.target = argv[optind];
+    o.client.parity = o.line.parity;
+    o.client.stopBits = o.line.stopBits;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned int i = 0; i < o.threads; ++i)
+    {
+        workers.emplace_back(new Worker());
+        workers.back()->options = &o;
+        workers.back()->index = i;
+
+        if (!Connect(workers.back().get()))
+        {
+            fprintf(stderr, "Не удалось подключиться к %s\n", o.target.c_str());
+            return 1;
+        }
+    }
+
+    long long started = ModbusLoop::Now();
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < o.threads; ++i)
+        threads.emplace_back(Run, workers[i].get());
+    for (unsigned int i = 0; i < o.threads; ++i)
+        threads[i].join();
+
+    double elapsed = (ModbusLoop::Now() - started) / 1000000.0;
+
+    //Сведение результатов потоков
+    Histogram latency;
+    unsigned long long errors[256] = { 0 };
+    unsigned long long overload = 0, unsent = 0;
+    for (unsigned int i = 0; i < o.threads; ++i)
+    {
+        latency.Merge(workers[i]->latency);
+        for (unsigned int e = 0; e < 256; ++e)
+            errors[e] += workers[i]->errors[e];
+        overload += workers[i]->overload;
+        unsent += workers[i]->unsent;
+    }
+
+    printf("Режим: %s, потоков: %u, время: %.2f с\n",
+           o.rate > 0 ? "открытый цикл" : "закрытый цикл", o.threads, elapsed);
+    printf("Выполнено запросов: %llu (%.1f в секунду), успешно: %llu\n",
+           latency.Total() - unsent, (latency.Total() - unsent) / elapsed, errors[0]);
+
+    for (unsigned int e = 1; e < 256; ++e)
+    {
+        if (errors[e])
+            printf("Ошибка 0x%02X: %llu\n", e, errors[e]);
+    }
+
+    printf("Задержка, мкс: p50 %lld, p99 %lld, p99.9 %lld, max %lld\n",
+           latency.Percentile(0.5), latency.Percentile(0.99), latency.Percentile(0.999), latency.Maximum());
+
+    //Признак насыщения: цель не успевала за расписанием, задержки выше включают ожидание места
+    if (overload)
+        printf("Насыщение: %llu запросов ждали места под пределом незавершённых, "
+               "%llu не отправлены до конца (учтены в задержке)\n", overload, unsent);
+
+    return 0;
+}
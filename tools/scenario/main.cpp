@@ -0,0 +1,202 @@
+/*
+    Воспроизведение сценария воздействий на парк счётчиков.
+
+    Парк создаётся пустым (--devices) или из манифеста (--manifest,
+    см. provisioning.h), часы выставляются на начало из сценария, затем
+    такты идут подряд без ожидания, пока не истечёт длительность
+    сценария. Итог - скорость моделирования относительно реального
+    времени, число применённых событий и тревог, а также контрольная
+    сумма памяти всех счётчиков: при том же сценарии и зерне она
+    совпадает между запусками и сборками, поэтому сравнение
+    производительности сборок можно начинать с проверки, что они
+    моделируют одно и то же.
+*/
+
+#include <chrono>
+#include <getopt.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fleet.h"
+#include "fleet_export.h"
+#include "provisioning.h"
+#include "scenario.h"
+
+
+//Контрольная сумма памяти всех счётчиков (FNV-1a)
+static unsigned long long FleetChecksum(const Fleet& fleet)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    unsigned char image[ALL_MEMORY_SIZE];
+
+    for (unsigned int d = 0; d < fleet.Count(); ++d)
+    {
+        fleet.Load(d, image);
+        for (unsigned int i = 0; i < ALL_MEMORY_SIZE; ++i)
+            hash = (hash ^ image[i]) * 0x100000001B3ULL;
+        hash = (hash ^ fleet.State(d)) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+
+static void Usage()
+{
+    fprintf(stderr,
+            "Использование: scenario [параметры] файл-сценария\n"
+            "Параметры:\n"
+            "  --devices N      размер пустого парка (по умолчанию 10000)\n"
+            "  --manifest PATH  создать парк из манифеста (CSV или двоичного)\n"
+            "  --threads N      потоков разбора манифеста (по умолчанию по числу ядер)\n"
+            "  --seed N         заменить зерно сценария\n"
+            "  --tick MS        заменить длительность такта (итог от неё не зависит, меняется скорость)\n"
+            "  --export NAME    выгружать образы счётчиков в разделяемую память NAME\n"
+            "  --schedule       вывести расписание событий и завершиться\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int devices = 10000;
+    const char* manifest = NULL;
+    unsigned int threads = 0;
+    const char* seed = NULL;
+    unsigned int tickMs = 0;
+    const char* exportName = NULL;
+    bool isSchedule = false;
+
+    static const option longOptions[] =
+    {
+        { "devices",  required_argument, 0, 'd' },
+        { "manifest", required_argument, 0, 'm' },
+        { "threads",  required_argument, 0, 't' },
+        { "seed",     required_argument, 0, 's' },
+        { "tick",     required_argument, 0, 'k' },
+        { "export",   required_argument, 0, 'e' },
+        { "schedule", no_argument,       0, 'p' },
+        { "help",     no_argument,       0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "d:m:t:s:k:e:ph", longOptions, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'd': devices = atoi(optarg); break;
+        case 'm': manifest = optarg; break;
+        case 't': threads = atoi(optarg); break;
+        case 's': seed = optarg; break;
+        case 'k': tickMs = atoi(optarg); break;
+        case 'e': exportName = optarg; break;
+        case 'p': isSchedule = true; break;
+        default:
+            Usage();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc || (!manifest && !devices))
+    {
+        Usage();
+        return 1;
+    }
+
+    //Парк
+    std::unique_ptr<Fleet> fleet;
+    if (manifest)
+    {
+        ProvisionReport report;
+        fleet.reset(ProvisionFleet(manifest, threads, report));
+        if (!fleet)
+        {
+            fprintf(stderr, "%s: %s\n", manifest, report.error);
+            return 1;
+        }
+        if (report.badRecords || report.duplicates)
+            fprintf(stderr, "%s: ошибочных записей %u, повторных адресов %u\n",
+                    manifest, report.badRecords, report.duplicates);
+    }
+    else
+        fleet.reset(new Fleet(devices));
+
+    Scenario scenario;
+    if (seed)
+        scenario.SetSeed(strtoull(seed, NULL, 0));
+
+    bool isCompiled = scenario.Load(argv[optind], fleet->Count());
+    if (!isCompiled)
+    {
+        if (scenario.ErrorLine())
+            fprintf(stderr, "%s:%u: %s\n", argv[optind], scenario.ErrorLine(), scenario.Error());
+        else
+            fprintf(stderr, "%s: %s\n", argv[optind], scenario.Error());
+        return 1;
+    }
+
+    if (!tickMs)
+        tickMs = scenario.TickMs();
+
+    const std::vector<ScenarioEvent>& events = scenario.Events();
+    if (isSchedule)
+    {
+        static const char* names[] = { "crack", "reverse", "magnet", "button", "stop", "flow" };
+        for (unsigned int i = 0; i < events.size(); ++i)
+        {
+            if (events[i].action == SCENARIO_FLOW)
+                printf("%lld %u flow %u\n", events[i].time, events[i].device, events[i].value);
+            else
+                printf("%lld %u %s\n", events[i].time, events[i].device, names[events[i].action]);
+        }
+        return 0;
+    }
+
+    FleetExport exporter;
+    if (exportName)
+    {
+        if (!exporter.Open(exportName, fleet->Count()))
+        {
+            fprintf(stderr, "Не удалось создать разделяемую память %s\n", exportName);
+            return 1;
+        }
+        fleet->Export(&exporter);
+    }
+
+    //Моделирование без ожидания между тактами
+    fleet->SetClock(scenario.Start());
+    fleet->Play(&scenario);
+
+    unsigned long long ticks = 0;
+    auto started = std::chrono::steady_clock::now();
+
+    long long end = scenario.Start() + scenario.DurationMs();
+    while (fleet->Clock() < end)
+    {
+        long long left = end - fleet->Clock();
+        fleet->Tick(left < tickMs ? (unsigned int)left : tickMs);
+        ++ticks;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    unsigned int alarms = 0;
+    for (unsigned int d = 0; d < fleet->Count(); ++d)
+        alarms += fleet->State(d) == ALARM;
+
+    printf("Счётчиков: %u, событий в расписании: %zu, применено: %u\n",
+           fleet->Count(), events.size(), scenario.Applied());
+    printf("Модельное время: %.1f ч, тактов: %llu, затрачено: %.3f с (быстрее реального в %.0f раз)\n",
+           scenario.DurationMs() / 3600000.0, ticks, seconds,
+           seconds > 0 ? scenario.DurationMs() / 1000.0 / seconds : 0.0);
+    printf("Тактов в секунду: %.0f, счётчико-тактов в секунду: %.3g\n",
+           seconds > 0 ? ticks / seconds : 0.0, seconds > 0 ? (double)ticks * fleet->Count() / seconds : 0.0);
+    printf("Счётчиков в тревоге: %u\n", alarms);
+    printf("Контрольная сумма: %016llx\n", FleetChecksum(*fleet));
+
+    fleet->Play(NULL);
+    fleet->Export(NULL);
+
+    return 0;
+}
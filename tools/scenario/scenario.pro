@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Воспроизведение сценариев воздействий на парк счётчиков (без Qt)
+#
+#-------------------------------------------------
+
+QT -= core gui
+CONFIG += console c++2a
+CONFIG -= app_bundle qt
+
+TARGET = scenario
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+LIBS += -lpthread -lrt
+
+SOURCES += \
+    main.cpp \
+    ../../scenario.cpp \
+    ../../fleet.cpp \
+    ../../fleet_export.cpp \
+    ../../provisioning.cpp \
+    ../../alarm_table.cpp \
+    ../../register_watch.cpp \
+    ../../Modbus/modbus_general.cpp
+
+HEADERS += \
+    ../../scenario.h \
+    ../../fleet.h \
+    ../../fleet_export.h \
+    ../../fleet_shm.h \
+    ../../provisioning.h \
+    ../../alarm_table.h \
+    ../../register_watch.h \
+    ../../device_types.h \
+    ../../modbus_device.h \
+    ../../Modbus/modbus_general.h \
+    ../../Modbus/modbus_slave.h \
+    ../../Modbus/counter_rng.h
@@ -0,0 +1,96 @@
+#include "shm_reader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+int FleetShmOpen(FleetShm* shm, const char* name)
+{
+    memset(shm, 0, sizeof(*shm));
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return FLEET_SHM_ERROR;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (unsigned long long)info.st_size < FLEET_SHM_SLOT_SIZE)
+    {
+        close(fd);
+        errno = EINVAL;
+        return FLEET_SHM_ERROR;
+    }
+
+    //Отображение не зависит от дескриптора, он больше не нужен
+    void* memory = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return FLEET_SHM_ERROR;
+
+    const struct FleetShmHeader* header = (const struct FleetShmHeader*)memory;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FLEET_SHM_MAGIC
+            || header->version != FLEET_SHM_VERSION
+            || header->slotSize != FLEET_SHM_SLOT_SIZE
+            || header->imageSize != FLEET_SHM_IMAGE_SIZE
+            || FLEET_SHM_SIZE(header->count) > (unsigned long long)info.st_size)
+    {
+        munmap(memory, info.st_size);
+        errno = EPROTO;
+        return FLEET_SHM_ERROR;
+    }
+
+    shm->header = header;
+    shm->slots = (const struct FleetShmSlot*)((const unsigned char*)memory + FLEET_SHM_SLOT_SIZE);
+    shm->size = info.st_size;
+    shm->count = header->count;
+
+    return FLEET_SHM_OK;
+}
+
+
+void FleetShmClose(FleetShm* shm)
+{
+    if (shm->header)
+        munmap((void*)shm->header, shm->size);
+
+    memset(shm, 0, sizeof(*shm));
+}
+
+
+int FleetShmRead(const FleetShm* shm, unsigned int device, unsigned int offset, void* dest, unsigned int size)
+{
+    if (device >= shm->count || offset > FLEET_SHM_IMAGE_SIZE || size > FLEET_SHM_IMAGE_SIZE - offset)
+        return FLEET_SHM_RANGE;
+
+    const struct FleetShmSlot* slot = &shm->slots[device];
+
+    for (int i = 0; i < FLEET_SHM_RETRIES; ++i)
+    {
+        unsigned int before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+
+        memcpy(dest, slot->image + offset, size);
+
+        //Копия не должна переместиться за повторное чтение последовательности
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before)
+            return FLEET_SHM_OK;
+    }
+
+    return FLEET_SHM_BUSY;
+}
+
+
+long long FleetShmClock(const FleetShm* shm)
+{
+    return __atomic_load_n(&shm->header->clock, __ATOMIC_RELAXED);
+}
+
+
+unsigned long long FleetShmPublishes(const FleetShm* shm)
+{
+    return __atomic_load_n(&shm->header->publishes, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,62 @@
+#ifndef SHM_READER_H
+#define SHM_READER_H
+
+#include "fleet_shm.h"
+
+/*
+    Библиотека на C для чтения образов памяти счётчиков, выгруженных
+    моделированием в разделяемую память (FleetExport, разметка -
+    fleet_shm.h).
+
+    Сегмент отображается только для чтения; чтение регистров - копирование
+    из отображённой памяти под seqlock ячейки, без системных вызовов и
+    без блокировок. Программы со старой glibc компонуются с -lrt. Пример:
+
+        FleetShm shm;
+        if (FleetShmOpen(&shm, "/metrolator") == 0)
+        {
+            unsigned int liters;    //показания RG_TV (смещение 0x30)
+            if (FleetShmRead(&shm, 5, 0x30, &liters, 4) == FLEET_SHM_OK)
+                ...
+            FleetShmClose(&shm);
+        }
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLEET_SHM_RETRIES       (1000)  //попыток чтения ячейки, пока писатель её меняет
+
+//Коды возврата
+#define FLEET_SHM_OK            (0)
+#define FLEET_SHM_ERROR         (-1)    //системная ошибка (errno) или неверная разметка сегмента
+#define FLEET_SHM_RANGE         (-2)    //нет такого счётчика или диапазон вне образа
+#define FLEET_SHM_BUSY          (-3)    //ячейку не удалось прочитать согласованно за FLEET_SHM_RETRIES попыток
+
+typedef struct FleetShm
+{
+    const struct FleetShmHeader* header;
+    const struct FleetShmSlot* slots;
+    unsigned long long size;        //размер отображения
+    unsigned int count;             //количество счётчиков
+} FleetShm;
+
+//Открыть сегмент name и проверить его разметку
+int FleetShmOpen(FleetShm* shm, const char* name);
+
+void FleetShmClose(FleetShm* shm);
+
+/*Согласованная копия size байт образа счётчика device начиная со смещения offset (RG_*);
+для образа целиком - offset 0, size FLEET_SHM_IMAGE_SIZE*/
+int FleetShmRead(const FleetShm* shm, unsigned int device, unsigned int offset, void* dest, unsigned int size);
+
+//Модельное время последней выгрузки (мс от 01.01.2000) и количество выгрузок
+long long FleetShmClock(const FleetShm* shm);
+unsigned long long FleetShmPublishes(const FleetShm* shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHM_READER_H
@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Библиотека чтения образов счётчиков из разделяемой памяти (C, без Qt)
+#
+#-------------------------------------------------
+
+QT -= core gui
+CONFIG += staticlib
+CONFIG -= qt
+
+TARGET = shmreader
+TEMPLATE = lib
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    shm_reader.c
+
+HEADERS += \
+    shm_reader.h \
+    ../../fleet_shm.h